@@ -17,35 +17,67 @@ Item {
     property int selectedRow: -1            // Selected row in grid
     property string selectedId: ""          // Id of selected row in grid
     property int minimumColumnWidth: 80     // Minimum column wodth
+    property string pendingId: ""           // Id to select once a background load completes
     signal sortRequested(var columnName)    // Signal emitted when a column header is clicked
 
     // When a column is clicked
     onSortRequested: (columnName) => {
+        pendingId   = selectedId
         selectedRow = model.sortBy(columnName, selectedId)
+        if (selectedRow >= 0) pendingId = ""   // Sorted in memory, no load to wait for
         sortOrder   = model.sortOrder
         sortColumn  = model.sortColumn
     }
 
-    // When component is loaded
+    // When component is loaded, reload only rows changed since the model was last loaded
     Component.onCompleted: {
         sortOrder   = model.sortOrder
         sortColumn  = model.sortColumn
-        model.refresh(selectedId)
+        model.refreshChanges()
     }
 
     /*
-     * Refresh grid after form is closed
+     * Select last record after form is closed
+     *
+     * The model has already patched the record in place, so it only
+     * needs to be located. A record not loaded yet is selected once the
+     * next load completes.
      *
      * @param lastId Id of last record added or changed
      */
     function refresh(lastId) {
         if (lastId !== "") {
-            selectedRow = model.refresh(lastId)
-            if (selectedRow >= 0) selectedId = lastId;
+            selectedRow = model.rowOf(lastId)
+            if (selectedRow >= 0) selectedId = lastId
+            else pendingId = lastId
         }
         stackView.pop()
     }
 
+    // Find the selected record again after rows were added, removed or moved
+    function relocate() {
+        selectedRow = selectedId !== "" ? model.rowOf(selectedId) : -1
+    }
+
+    // Select located record once a background load requested here completes,
+    // otherwise (poll or notification reload) keep the current record selected
+    Connections {
+        target: model
+        function onLoaded(foundIdx) {
+            if (pendingId !== "" && foundIdx >= 0) {
+                selectedRow = foundIdx
+                selectedId  = pendingId
+            } else {
+                relocate()
+            }
+            pendingId = ""
+        }
+        function onRowsInserted() { relocate() }
+        function onRowsRemoved() { relocate() }
+        function onRowsMoved() { relocate() }
+        function onLayoutChanged() { relocate() }
+    }
+
     // Delete confirmation box
     MsgBox {
         id: msgBox
@@ -131,6 +163,20 @@ Item {
                     msgBox.open()
                 }
             }
+            TextField {
+                id: searchField
+                width: 200
+                placeholderText: "🔍 Search"
+
+                property string searchColumn: ""      // Column the search filter was applied to
+
+                // Filter the sort column; the model debounces changes into one query
+                onTextEdited: {
+                    if (searchColumn !== "") model.removeFilter(searchColumn)
+                    searchColumn = text !== "" ? sortColumn : ""
+                    if (searchColumn !== "") model.setFilter(searchColumn, "like", "%" + text + "%")
+                }
+            }
         }
     }
 
@@ -212,6 +258,13 @@ Item {
         // Trigger layout recalculation when needed
         Component.onCompleted: table.forceLayout()
 
+        // Load next page when scrolled to the bottom
+        onAtYEndChanged: {
+            const root = dataTable.model.index(-1, -1)
+            if (atYEnd && dataTable.model.canFetchMore(root))
+                dataTable.model.fetchMore(root)
+        }
+
         delegate:  Label {
             text: model.celldata
             width: 100
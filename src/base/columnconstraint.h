@@ -3,7 +3,11 @@
 
 #include <QObject>
 #include <QMap>
+#include <QRegularExpression>
+#include <QStringList>
 #include <QVariant>
+#include <QVector>
+#include <algorithm>
 
 enum class ConstraintType {                         // Column constraint types
     EnumSet,
@@ -15,6 +19,20 @@ enum class ConstraintType {                         // Column constraint types
 struct ColumnConstraint {                           // Column constraint structure
     ConstraintType type;                            // Type of constraint
     virtual ~ColumnConstraint() = default;          // Constraint properties object
+
+    /**
+     * @brief Check a value against the constraint
+     *
+     * Null values always pass, as they do for SQL check constraints. Checking
+     * must not modify the constraint, so that rows can be checked in parallel.
+     *
+     * @param value Value to be checked
+     * @returns Error text, empty if the value is valid
+     */
+    virtual QString check(const QVariant &value) const {
+        Q_UNUSED(value)
+        return QString();
+    }
 };
 
 /**
@@ -61,6 +79,218 @@ struct EnumConstraint : public ColumnConstraint {
     QList<int> allowedValues() const {
         return valueMap.keys();
     }
+
+    /**
+     * @brief Check that a value is one of the enumerated values
+     *
+     * @param value Value to be checked
+     * @returns Error text, empty if the value is valid
+     */
+    QString check(const QVariant &value) const override {
+        bool isInt = false;
+        const int number = value.toInt(&isInt);
+        if (value.isNull() || (isInt && valueMap.contains(number)))
+            return QString();
+        return QString("%1 is not an allowed value").arg(value.toString());
+    }
+};
+
+/**
+ * @brief The range constraint class
+ *
+ * Either bound may be null to leave that end of the range open. Values are
+ * converted to the type of the bounds before being compared, so a number
+ * entered as text is checked as a number.
+ */
+struct RangeConstraint : public ColumnConstraint {
+    QVariant minimum;                               // Smallest allowed value, null for no minimum
+    QVariant maximum;                               // Largest allowed value, null for no maximum
+
+    /**
+     * @brief Range constraint class constructor
+     *
+     * @param minimum Smallest allowed value, null for no minimum
+     * @param maximum Largest allowed value, null for no maximum
+     */
+    RangeConstraint(const QVariant &minimum = QVariant(), const QVariant &maximum = QVariant()) : minimum(minimum), maximum(maximum) {
+        type = ConstraintType::Range;
+    }
+
+    /**
+     * @brief Check that a value lies within the range
+     *
+     * @param value Value to be checked
+     * @returns Error text, empty if the value is valid
+     */
+    QString check(const QVariant &value) const override {
+        if (value.isNull())
+            return QString();
+
+        // Compare as the type of the bounds
+        QVariant converted = value;
+        const QMetaType boundType = minimum.isNull() ? maximum.metaType() : minimum.metaType();
+        if (boundType.isValid() && !converted.convert(boundType))
+            return QString("%1 is not a valid value").arg(value.toString());
+
+        if (!minimum.isNull() && QVariant::compare(converted, minimum) == QPartialOrdering::Less)
+            return QString("%1 is less than %2").arg(value.toString(), minimum.toString());
+        if (!maximum.isNull() && QVariant::compare(converted, maximum) == QPartialOrdering::Greater)
+            return QString("%1 is greater than %2").arg(value.toString(), maximum.toString());
+        return QString();
+    }
+};
+
+/**
+ * @brief The regular expression constraint class
+ *
+ * The pattern must match the whole value. It is compiled, and JIT compiled
+ * where supported, when the constraint is created. Matching a compiled
+ * pattern only reads it, so one constraint can check rows on several threads.
+ */
+struct RegexConstraint : public ColumnConstraint {
+    QRegularExpression regex;                       // Compiled pattern anchored to the whole value
+    QString message;                                // Error text shown when a value does not match
+
+    /**
+     * @brief Regular expression constraint class constructor
+     *
+     * @param pattern Pattern values must match in full
+     * @param message Error text shown when a value does not match, blank to show the pattern
+     */
+    RegexConstraint(const QString &pattern, const QString &message = QString())
+        : regex(QRegularExpression::anchoredPattern(pattern)), message(message) {
+        type = ConstraintType::Regex;
+        regex.optimize();
+    }
+
+    /**
+     * @brief Check that a value matches the pattern
+     *
+     * @param value Value to be checked
+     * @returns Error text, empty if the value is valid
+     */
+    QString check(const QVariant &value) const override {
+        if (!regex.isValid())
+            return QString("invalid pattern: %1").arg(regex.errorString());
+        if (value.isNull() || regex.match(value.toString()).hasMatch())
+            return QString();
+        if (!message.isEmpty())
+            return message;
+        return QString("%1 does not match %2").arg(value.toString(), regex.pattern());
+    }
+};
+
+/**
+ * @brief Lookup table decoding enumerated values to their labels
+ *
+ * Values index a dense table starting at the smallest value, so decoding a
+ * value is an array lookup. Each value also has a rank, the position of its
+ * label in label order, so that rows can be sorted by label by comparing
+ * integers.
+ */
+struct EnumLabels {
+    int minimum = 0;                                // Smallest enumerated value
+    QStringList labels;                             // Label of each value from the smallest, null for gaps
+    QVector<int> ranks;                             // Position of each value's label in label order, -1 for gaps
+    int unknownRank = 0;                            // Rank of values without a label, after every label
+    bool valueOrdered = true;                       // True when label order is the same as value order
+
+    /**
+     * @brief Enumeration lookup constructor
+     *
+     * @param constraint Enumeration constraint holding the values and labels
+     */
+    explicit EnumLabels(const EnumConstraint &constraint) {
+        const QList<int> values = constraint.allowedValues();
+        if (values.isEmpty())
+            return;
+
+        minimum = values.first();
+        labels.resize(values.last() - minimum + 1);
+        ranks.fill(-1, labels.size());
+        for (int value : values)
+            labels[value - minimum] = constraint.labelFor(value);
+
+        // Rank values by label
+        QList<int> ordered = values;
+        std::stable_sort(ordered.begin(), ordered.end(), [&](int value, int other) {
+            return QString::localeAwareCompare(labels.at(value - minimum), labels.at(other - minimum)) < 0;
+        });
+        for (int rank = 0; rank < ordered.size(); ++rank)
+            ranks[ordered.at(rank) - minimum] = rank;
+        unknownRank = ordered.size();
+        valueOrdered = ordered == values;
+    }
+
+    /**
+     * @brief Retrieve label for enumerated value
+     *
+     * @param value Value of enumeration
+     * @returns Label associated with value or "Unknown"
+     */
+    QString label(qint64 value) const {
+        const qint64 index = value - minimum;
+        return index >= 0 && index < ranks.size() && ranks.at(index) >= 0 ? labels.at(index) : QString("Unknown");
+    }
+
+    /**
+     * @brief Retrieve rank of enumerated value in label order
+     *
+     * @param value Value of enumeration
+     * @returns Rank of the value's label, values without a label rank last
+     */
+    int rank(qint64 value) const {
+        const qint64 index = value - minimum;
+        return index >= 0 && index < ranks.size() && ranks.at(index) >= 0 ? ranks.at(index) : unknownRank;
+    }
+
+    /**
+     * @brief Retrieve the values whose labels match a pattern
+     *
+     * The pattern is matched the way ILIKE matches it: ignoring case, with %
+     * matching any text, _ matching any one character and a backslash escaping either.
+     *
+     * @param pattern Pattern to be matched
+     * @returns Matching values
+     */
+    QVariantList valuesLike(const QString &pattern) const {
+        QString expression;
+        for (int i = 0; i < pattern.size(); ++i) {
+            const QChar ch = pattern.at(i);
+            if (ch == QLatin1Char('\\') && i + 1 < pattern.size())
+                expression += QRegularExpression::escape(pattern.at(++i));
+            else if (ch == QLatin1Char('%'))
+                expression += ".*";
+            else if (ch == QLatin1Char('_'))
+                expression += ".";
+            else
+                expression += QRegularExpression::escape(ch);
+        }
+        const QRegularExpression like(QRegularExpression::anchoredPattern(expression),
+                                      QRegularExpression::CaseInsensitiveOption | QRegularExpression::DotMatchesEverythingOption);
+
+        QVariantList values;
+        for (int index = 0; index < labels.size(); ++index) {
+            if (ranks.at(index) >= 0 && like.match(labels.at(index)).hasMatch())
+                values << minimum + index;
+        }
+        return values;
+    }
+
+    /**
+     * @brief Retrieve the values having a label
+     *
+     * @param label Label to be found
+     * @returns Values having the label
+     */
+    QVariantList valuesLabeled(const QString &label) const {
+        QVariantList values;
+        for (int index = 0; index < labels.size(); ++index) {
+            if (ranks.at(index) >= 0 && labels.at(index) == label)
+                values << minimum + index;
+        }
+        return values;
+    }
 };
 
 #endif // COLUMNCONSTRAINT_H
@@ -0,0 +1,531 @@
+#include "connectionpool.h"
+#include "statementcache.h"
+#include "unitofwork.h"
+#include <QAbstractEventDispatcher>
+#include <QDeadlineTimer>
+#include <QHash>
+#include <QMutexLocker>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QThread>
+#include <QDebug>
+
+namespace {
+QMutex registryMutex;                               // Guards the registry of pools
+QHash<QString, std::shared_ptr<ConnectionPool>> registry; // Pools by source connection name
+constexpr int closedBackendGrace = 10000;           // Milliseconds the server process of a closed connection is still owned
+
+/**
+ * @brief Get the server process serving a connection
+ *
+ * @param db Open connection belonging to the current thread
+ * @returns Process id or 0 if it could not be read
+ */
+int backendPid(const QSqlDatabase &db) {
+    QSqlQuery query(db);
+    if (query.exec("SELECT pg_backend_pid()") && query.next())
+        return query.value(0).toInt();
+    return 0;
+}
+}
+
+/**
+ * @brief Lease constructor
+ *
+ * @param pool Pool the connection is returned to
+ * @param name Name of leased connection
+ */
+ConnectionLease::ConnectionLease(std::shared_ptr<ConnectionPool> pool, const QString &name) : m_pool(std::move(pool)), m_name(name) {
+    m_held.start();
+}
+
+/**
+ * @brief Move constructor
+ *
+ * @param other Lease to take over
+ */
+ConnectionLease::ConnectionLease(ConnectionLease &&other) noexcept : m_pool(std::move(other.m_pool)), m_name(std::move(other.m_name)), m_held(other.m_held) {
+    other.m_pool.reset();
+}
+
+/**
+ * @brief Move assignment
+ *
+ * Any connection currently held is returned first.
+ *
+ * @param other Lease to take over
+ * @returns This lease
+ */
+ConnectionLease &ConnectionLease::operator=(ConnectionLease &&other) noexcept {
+    if (this != &other) {
+        release();
+        m_pool = std::move(other.m_pool);
+        m_name = std::move(other.m_name);
+        m_held = other.m_held;
+        other.m_pool.reset();
+    }
+    return *this;
+}
+
+/**
+ * @brief Destructor, returns the connection to the pool
+ */
+ConnectionLease::~ConnectionLease() {
+    release();
+}
+
+/**
+ * @brief Determine if a connection is held
+ *
+ * @returns True if a connection is held, otherwise false
+ */
+bool ConnectionLease::isValid() const {
+    return m_pool != nullptr;
+}
+
+/**
+ * @brief Get the leased connection
+ *
+ * @returns Leased connection or an invalid connection when nothing is held
+ */
+QSqlDatabase ConnectionLease::database() const {
+    return m_pool ? QSqlDatabase::database(m_name, false) : QSqlDatabase();
+}
+
+/**
+ * @brief Return the connection to the pool ahead of destruction
+ */
+void ConnectionLease::release() {
+    if (m_pool) {
+        m_pool->release(m_name, m_held.elapsed());
+        m_pool.reset();
+    }
+}
+
+/**
+ * @brief Connection pool constructor
+ *
+ * The source connection is adopted as the connection of the thread that
+ * creates the pool, so leases taken on that thread share it with code
+ * using the connection directly.
+ *
+ * @param db Open source connection, cloned for other threads
+ * @param keepOpen Connections the reaper leaves open however long they are idle
+ * @param maxSize Upper bound on open connections
+ * @param idleTimeout Milliseconds before an idle connection is closed
+ */
+ConnectionPool::ConnectionPool(const QSqlDatabase &db, int keepOpen, int maxSize, int idleTimeout) {
+    m_sourceName = db.connectionName();
+    m_maxSize = qMax(1, maxSize);
+    m_keepOpen = qBound(1, keepOpen, m_maxSize);
+    m_idleTimeout = idleTimeout;
+
+    Entry source;
+    source.name = m_sourceName;
+    source.thread = QThread::currentThread();
+    source.pinned = true;
+    source.backendPid = db.isOpen() ? backendPid(db) : 0;
+    source.idle.start();
+    m_entries << source;
+    m_opened = 1;
+}
+
+/**
+ * @brief Destructor
+ *
+ * Pooled connections still open are removed. Connections of threads that are
+ * still running should have been closed by those threads with releaseThread.
+ */
+ConnectionPool::~ConnectionPool() {
+    QMutexLocker locker(&m_mutex);
+    for (int i = m_entries.size() - 1; i >= 0; --i) {
+        if (!m_entries.at(i).pinned) {
+            if (m_entries.at(i).thread != QThread::currentThread())
+                qDebug() << m_entries.at(i).name << "removed from outside its thread";
+            closeEntry(i);
+        }
+    }
+}
+
+/**
+ * @brief Create a pool for a connection and register it
+ *
+ * @param db Open source connection, cloned for other threads
+ * @param keepOpen Connections the reaper leaves open however long they are idle
+ * @param maxSize Upper bound on open connections
+ * @param idleTimeout Milliseconds before an idle connection is closed
+ * @returns Connection pool
+ */
+std::shared_ptr<ConnectionPool> ConnectionPool::create(const QSqlDatabase &db, int keepOpen, int maxSize, int idleTimeout) {
+    std::shared_ptr<ConnectionPool> pool(new ConnectionPool(db, keepOpen, maxSize, idleTimeout));
+    QMutexLocker locker(&registryMutex);
+    registry.insert(db.connectionName(), pool);
+    return pool;
+}
+
+/**
+ * @brief Retrieve the pool registered for a connection
+ *
+ * @param connectionName Name of source connection
+ * @returns Connection pool or nullptr if none is registered
+ */
+std::shared_ptr<ConnectionPool> ConnectionPool::forConnection(const QString &connectionName) {
+    QMutexLocker locker(&registryMutex);
+    return registry.value(connectionName);
+}
+
+/**
+ * @brief Unregister the pool of a connection
+ *
+ * The pool is destroyed once its last outstanding lease is returned.
+ *
+ * @param connectionName Name of source connection
+ */
+void ConnectionPool::remove(const QString &connectionName) {
+    QMutexLocker locker(&registryMutex);
+    registry.remove(connectionName);
+}
+
+/**
+ * @brief Lease a connection for the current thread
+ *
+ * A thread that already holds a lease shares the same connection, so nested
+ * work runs inside any transaction the thread has open. Otherwise an idle
+ * connection opened by this thread is reused, or a new one is opened while
+ * under the maximum size. Connections idle for a while are checked and
+ * reopened before being handed out, and a source connection that cannot be
+ * reopened fails the call. When the pool is full the thread owning an idle
+ * connection is asked to close it, since a connection is only usable by the
+ * thread that opened it, and the call waits for a connection to be returned
+ * or closed.
+ *
+ * @param timeout Milliseconds to wait for a connection
+ * @returns Lease that returns the connection when destroyed, invalid on failure
+ */
+ConnectionLease ConnectionPool::acquire(int timeout) {
+    QThread *thread = QThread::currentThread();
+    QElapsedTimer waited;
+    QMutexLocker locker(&m_mutex);
+
+    waited.start();
+    for (;;) {
+        // Find connection held or idle on this thread
+        int found = -1;
+        for (int i = 0; i < m_entries.size(); ++i) {
+            const Entry &entry = m_entries.at(i);
+            if (entry.thread == thread && (found < 0 || entry.leases > 0))
+                found = i;
+        }
+        if (found >= 0) {
+            Entry &entry = m_entries[found];
+            const QString name = entry.name;
+            const bool needsCheck = entry.leases == 0 && entry.idle.elapsed() >= m_checkAfter;
+            entry.leases += 1;
+            entry.closeRequested = false;
+
+            // Check the reserved connection without holding up other threads
+            if (needsCheck || !QSqlDatabase::database(name, false).isOpen()) {
+                locker.unlock();
+                QString error;
+                int pid = 0;
+                const bool healthy = checkHealth(name, pid, error);
+                locker.relock();
+                if (healthy && indexOf(name) >= 0)
+                    setBackendPid(indexOf(name), pid);
+                if (!healthy) {
+                    m_failedChecks += 1;
+                    qDebug() << name << "failed health check:" << error;
+                    const int index = indexOf(name);
+                    if (index >= 0 && m_entries.at(index).pinned) {
+                        m_entries[index].leases -= 1;
+                        m_returned.wakeAll();
+                        return ConnectionLease();
+                    }
+                    if (index >= 0)
+                        closeEntry(index);
+                    continue;
+                }
+            }
+            m_leases += 1;
+            m_waitTime += waited.elapsed();
+            return ConnectionLease(shared_from_this(), name);
+        }
+
+        // Open another connection while under the maximum
+        if (m_entries.size() < m_maxSize) {
+            Entry entry;
+            entry.name = QString("%1_pool_%2").arg(m_sourceName).arg(++m_nextId);
+            entry.thread = thread;
+            entry.leases = 1;
+            m_entries << entry;
+            locker.unlock();
+            QSqlDatabase db = QSqlDatabase::cloneDatabase(m_sourceName, entry.name);
+            const bool opened = db.open();
+            const QString error = db.lastError().text();
+            const int pid = opened ? backendPid(db) : 0;
+            db = QSqlDatabase();
+            locker.relock();
+            if (!opened) {
+                qDebug() << entry.name << "open failed:" << error;
+                const int index = indexOf(entry.name);
+                if (index >= 0)
+                    m_entries.removeAt(index);
+                QSqlDatabase::removeDatabase(entry.name);
+                m_returned.wakeAll();
+                return ConnectionLease();
+            }
+            if (indexOf(entry.name) >= 0)
+                setBackendPid(indexOf(entry.name), pid);
+            m_opened += 1;
+            m_leases += 1;
+            m_waitTime += waited.elapsed();
+            return ConnectionLease(shared_from_this(), entry.name);
+        }
+
+        // Wait for a connection to be returned or closed, freeing an idle one held by another thread
+        requestClose(thread);
+        const qint64 remaining = timeout - waited.elapsed();
+        if (remaining <= 0) {
+            m_timeouts += 1;
+            m_waitTime += waited.elapsed();
+            qDebug() << m_sourceName << "pool exhausted after" << waited.elapsed() << "ms";
+            return ConnectionLease();
+        }
+        m_waiters += 1;
+        m_peakWaiters = qMax(m_peakWaiters, m_waiters);
+        m_returned.wait(&m_mutex, QDeadlineTimer(remaining));
+        m_waiters -= 1;
+    }
+}
+
+/**
+ * @brief Close the idle connections opened by the current thread
+ *
+ * Threads that lease connections call this before finishing, since a
+ * connection may only be closed by the thread that opened it.
+ */
+void ConnectionPool::releaseThread() {
+    QMutexLocker locker(&m_mutex);
+    for (int i = m_entries.size() - 1; i >= 0; --i) {
+        const Entry &entry = m_entries.at(i);
+        if (entry.thread == QThread::currentThread() && entry.leases == 0 && !entry.pinned)
+            closeEntry(i);
+    }
+}
+
+/**
+ * @brief Close connections of the current thread idle beyond the idle timeout
+ *
+ * At least keepOpen connections, counting the source connection, are left open.
+ */
+void ConnectionPool::reap() {
+    QMutexLocker locker(&m_mutex);
+    for (int i = m_entries.size() - 1; i >= 0 && m_entries.size() > m_keepOpen; --i) {
+        const Entry &entry = m_entries.at(i);
+        if (entry.thread == QThread::currentThread() && entry.leases == 0 && !entry.pinned && entry.idle.elapsed() > m_idleTimeout)
+            closeEntry(i);
+    }
+}
+
+/**
+ * @brief Get pool statistics
+ *
+ * @returns Map of size, idle, leased, waiters, peakWaiters, timeouts, opened, closed,
+ *          failedChecks, leases, leaseTime, maxLeaseTime and waitTime (milliseconds)
+ */
+QVariantMap ConnectionPool::statistics() const {
+    QMutexLocker locker(&m_mutex);
+    int leased = 0;
+    for (const Entry &entry : m_entries)
+        leased += entry.leases > 0 ? 1 : 0;
+
+    return {
+        { "size", int(m_entries.size()) },
+        { "idle", int(m_entries.size()) - leased },
+        { "leased", leased },
+        { "waiters", m_waiters },
+        { "peakWaiters", m_peakWaiters },
+        { "timeouts", m_timeouts },
+        { "opened", m_opened },
+        { "closed", m_closed },
+        { "failedChecks", m_failedChecks },
+        { "leases", m_leases },
+        { "leaseTime", m_leaseTime },
+        { "maxLeaseTime", m_maxLeaseTime },
+        { "waitTime", m_waitTime }
+    };
+}
+
+/**
+ * @brief Ask the thread owning an idle connection to close it
+ *
+ * The request is queued to the event loop of the owning thread. Threads
+ * without an event loop are not asked and keep their connections until they
+ * release them. Must be called with the pool lock held.
+ *
+ * @param thread Thread waiting for a connection, whose own connections are not closed
+ * @returns True if a thread was asked, otherwise false
+ */
+bool ConnectionPool::requestClose(QThread *thread) {
+    for (Entry &entry : m_entries) {
+        if (entry.thread == thread || entry.pinned || entry.leases > 0 || entry.closeRequested)
+            continue;
+        QAbstractEventDispatcher *dispatcher = entry.thread->eventDispatcher();
+        if (!dispatcher)
+            continue;
+        entry.closeRequested = true;
+        const std::weak_ptr<ConnectionPool> pool = weak_from_this();
+        const QString name = entry.name;
+        QMetaObject::invokeMethod(dispatcher, [pool, name]() {
+            if (std::shared_ptr<ConnectionPool> owner = pool.lock())
+                owner->closeIdle(name);
+        }, Qt::QueuedConnection);
+        return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Close a connection of the current thread if it is still idle
+ *
+ * @param name Name of connection
+ */
+void ConnectionPool::closeIdle(const QString &name) {
+    QMutexLocker locker(&m_mutex);
+    const int index = indexOf(name);
+    if (index < 0)
+        return;
+    if (m_entries.at(index).leases == 0 && m_entries.at(index).thread == QThread::currentThread())
+        closeEntry(index);
+    else
+        m_entries[index].closeRequested = false;
+}
+
+/**
+ * @brief Determine if a server process serves a connection of this pool
+ *
+ * Processes of connections closed within the last few seconds still count,
+ * so that notifications sent by a connection just before it was closed are
+ * recognised.
+ *
+ * @param pid Server process id
+ * @returns True if the process serves, or recently served, a connection of this pool
+ */
+bool ConnectionPool::ownsBackend(int pid) const {
+    QMutexLocker locker(&m_mutex);
+    if (pid <= 0)
+        return false;
+    for (const Entry &entry : m_entries) {
+        if (entry.backendPid == pid)
+            return true;
+    }
+    const auto closed = m_closedBackends.constFind(pid);
+    return closed != m_closedBackends.constEnd() && closed.value().elapsed() < closedBackendGrace;
+}
+
+/**
+ * @brief Return a leased connection
+ *
+ * Idle connections of the current thread past the idle timeout are then closed.
+ *
+ * @param name Name of leased connection
+ * @param heldMs Milliseconds the connection was leased
+ */
+void ConnectionPool::release(const QString &name, qint64 heldMs) {
+    {
+        QMutexLocker locker(&m_mutex);
+        for (Entry &entry : m_entries) {
+            if (entry.name == name && entry.leases > 0) {
+                entry.leases -= 1;
+                if (entry.leases == 0)
+                    entry.idle.start();
+                break;
+            }
+        }
+        m_leaseTime += heldMs;
+        m_maxLeaseTime = qMax(m_maxLeaseTime, heldMs);
+        m_returned.wakeAll();
+    }
+    reap();
+}
+
+/**
+ * @brief Check a connection before it is handed out
+ *
+ * The connection is pinged and reopened if the ping fails. This runs
+ * without the pool lock held, as a dead server can keep it waiting.
+ *
+ * @param name Name of connection, reserved for and belonging to the current thread
+ * @param pid Returns the server process serving the connection
+ * @param error Returns error text when the connection is unusable
+ * @returns True if the connection is usable, otherwise false
+ */
+bool ConnectionPool::checkHealth(const QString &name, int &pid, QString &error) {
+    QSqlDatabase db = QSqlDatabase::database(name, false);
+    if (db.isOpen() && (pid = backendPid(db)) > 0)
+        return true;
+
+    StatementCache::forDatabase(db).invalidate();
+    db.close();
+    if (db.open()) {
+        pid = backendPid(db);
+        return true;
+    }
+    error = db.lastError().text();
+    return false;
+}
+
+/**
+ * @brief Record the server process serving a pooled connection
+ *
+ * A process replaced by a reopened connection is remembered as recently closed.
+ *
+ * @param index Index of connection in the pool
+ * @param pid Server process id, 0 if unknown
+ */
+void ConnectionPool::setBackendPid(int index, int pid) {
+    Entry &entry = m_entries[index];
+    if (entry.backendPid > 0 && entry.backendPid != pid)
+        m_closedBackends[entry.backendPid].start();
+    entry.backendPid = pid;
+}
+
+/**
+ * @brief Find a pooled connection
+ *
+ * @param name Name of connection
+ * @returns Index of connection in the pool or -1 if not found
+ */
+int ConnectionPool::indexOf(const QString &name) const {
+    for (int i = 0; i < m_entries.size(); ++i) {
+        if (m_entries.at(i).name == name)
+            return i;
+    }
+    return -1;
+}
+
+/**
+ * @brief Close and forget a pooled connection
+ *
+ * @param index Index of connection in the pool
+ */
+void ConnectionPool::closeEntry(int index) {
+    const QString name = m_entries.at(index).name;
+    setBackendPid(index, 0);
+    m_entries.removeAt(index);
+    for (auto it = m_closedBackends.begin(); it != m_closedBackends.end();) {
+        if (it.value().elapsed() >= closedBackendGrace)
+            it = m_closedBackends.erase(it);
+        else
+            ++it;
+    }
+    StatementCache::discard(name);
+    UnitOfWork::discard(name);
+    {
+        QSqlDatabase db = QSqlDatabase::database(name, false);
+        db.close();
+    }
+    QSqlDatabase::removeDatabase(name);
+    m_closed += 1;
+    m_returned.wakeAll();
+}
@@ -0,0 +1,98 @@
+#ifndef CONNECTIONPOOL_H
+#define CONNECTIONPOOL_H
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QSqlDatabase>
+#include <QString>
+#include <QVariantMap>
+#include <QWaitCondition>
+#include <memory>
+
+class QThread;
+class ConnectionPool;
+
+class ConnectionLease
+{
+public:
+    ConnectionLease() = default;
+    ConnectionLease(ConnectionLease &&other) noexcept;
+    ConnectionLease &operator=(ConnectionLease &&other) noexcept;
+    ConnectionLease(const ConnectionLease &) = delete;
+    ConnectionLease &operator=(const ConnectionLease &) = delete;
+    ~ConnectionLease();
+
+    bool isValid() const;
+    QSqlDatabase database() const;
+    void release();
+
+private:
+    friend class ConnectionPool;
+    ConnectionLease(std::shared_ptr<ConnectionPool> pool, const QString &name);
+
+    std::shared_ptr<ConnectionPool> m_pool;         // Pool the connection is returned to
+    QString m_name;                                 // Name of leased connection
+    QElapsedTimer m_held;                           // Time since the lease was taken
+};
+
+class ConnectionPool : public std::enable_shared_from_this<ConnectionPool>
+{
+public:
+    static std::shared_ptr<ConnectionPool> create(const QSqlDatabase &db, int keepOpen, int maxSize, int idleTimeout);
+    static std::shared_ptr<ConnectionPool> forConnection(const QString &connectionName);
+    static void remove(const QString &connectionName);
+    ~ConnectionPool();
+
+    ConnectionLease acquire(int timeout = 5000);
+    void releaseThread();
+    void reap();
+    QVariantMap statistics() const;
+    bool ownsBackend(int pid) const;
+
+private:
+    struct Entry {                                  // Pooled connection
+        QString name;                               // Connection name
+        QThread *thread = nullptr;                  // Thread that opened, and alone may use, the connection
+        int leases = 0;                             // Number of outstanding leases, nested leases share a connection
+        bool pinned = false;                        // True for the source connection, which is never closed by the pool
+        int backendPid = 0;                         // Server process serving the connection, 0 if unknown
+        bool closeRequested = false;                // True once the owning thread has been asked to close the idle connection
+        QElapsedTimer idle;                         // Time since the connection was last returned
+    };
+
+    ConnectionPool(const QSqlDatabase &db, int keepOpen, int maxSize, int idleTimeout);
+    void release(const QString &name, qint64 heldMs);
+    bool requestClose(QThread *thread);
+    void closeIdle(const QString &name);
+    bool checkHealth(const QString &name, int &pid, QString &error);
+    void setBackendPid(int index, int pid);
+    int indexOf(const QString &name) const;
+    void closeEntry(int index);
+
+    friend class ConnectionLease;
+
+    QString m_sourceName;                           // Connection the pooled connections are cloned from
+    int m_keepOpen;                                 // Connections the reaper leaves open however long idle
+    int m_maxSize;                                  // Upper bound on open connections
+    int m_idleTimeout;                              // Milliseconds before an idle connection is closed
+    int m_checkAfter = 30000;                       // Milliseconds idle before a connection is checked on checkout
+    mutable QMutex m_mutex;                         // Guards entries and statistics
+    QWaitCondition m_returned;                      // Signalled when a connection is returned or closed
+    QList<Entry> m_entries;                         // Open connections
+    QHash<int, QElapsedTimer> m_closedBackends;     // Server processes of recently closed connections, by pid
+    int m_nextId = 0;                               // Suffix of the next connection name
+    int m_waiters = 0;                              // Threads waiting for a connection
+    int m_peakWaiters = 0;                          // Most threads waiting at once
+    int m_timeouts = 0;                             // Acquisitions that gave up waiting
+    int m_opened = 0;                               // Connections opened
+    int m_closed = 0;                               // Connections closed
+    int m_failedChecks = 0;                         // Health checks that failed
+    int m_leases = 0;                               // Leases handed out
+    qint64 m_leaseTime = 0;                         // Total milliseconds connections were leased
+    qint64 m_maxLeaseTime = 0;                      // Longest a connection was leased in milliseconds
+    qint64 m_waitTime = 0;                          // Total milliseconds spent waiting for a connection
+};
+
+#endif // CONNECTIONPOOL_H
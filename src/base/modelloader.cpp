@@ -0,0 +1,325 @@
+#include "modelloader.h"
+#include "connectionpool.h"
+#include <QSqlDatabase>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QDebug>
+
+/**
+ * @brief Model loader constructor
+ *
+ * The loader runs model queries on its own worker thread using a connection
+ * leased from the pool of the given connection, so the thread owning the
+ * model is never blocked by the database. Rows are decoded on the worker
+ * thread and handed to the handler in a single batch. Windows are read the
+ * same way, one block at a time, and handed to the block handler.
+ *
+ * @param connectionName Name of connection whose pool is used on the worker thread
+ * @param handler Called on the owning thread with the result of the latest request
+ * @param parent Reference to parent class.
+ */
+ModelLoader::ModelLoader(const QString &connectionName, std::function<void(Result &)> handler, QObject *parent) : QObject(parent) {
+    m_sourceName = connectionName;
+    m_handler = handler;
+    setObjectName("ModelLoader");
+
+    m_worker = new QObject;
+    m_worker->moveToThread(&m_thread);
+    connect(&m_thread, &QThread::finished, m_worker, &QObject::deleteLater);
+    m_thread.start();
+}
+
+/**
+ * @brief Destructor
+ *
+ * Outstanding requests are abandoned, any open window is closed, the
+ * connections opened by the worker thread are closed and the worker thread
+ * is stopped.
+ */
+ModelLoader::~ModelLoader() {
+    m_latest = 0;
+    const QString sourceName = m_sourceName;
+    QMetaObject::invokeMethod(m_worker, [this, sourceName]() {
+        closeWindow();
+        if (std::shared_ptr<ConnectionPool> pool = ConnectionPool::forConnection(sourceName))
+            pool->releaseThread();
+    }, Qt::BlockingQueuedConnection);
+    m_thread.quit();
+    m_thread.wait();
+}
+
+/**
+ * @brief Queue a load request
+ *
+ * A request supersedes any request that has not yet been delivered. Superseded
+ * requests still waiting on the worker thread are skipped and results of
+ * superseded requests are discarded.
+ *
+ * @param request Description of the load
+ */
+void ModelLoader::submit(const Request &request) {
+    const quint64 generation = ++m_latest;
+    QMetaObject::invokeMethod(m_worker, [this, generation, request]() {
+        load(generation, request);
+    }, Qt::QueuedConnection);
+}
+
+/**
+ * @brief Determine if a request is outstanding
+ *
+ * @returns True while the latest request has not been delivered
+ */
+bool ModelLoader::isLoading() const {
+    return m_delivered != m_latest;
+}
+
+/**
+ * @brief Set the handler receiving blocks read from a window
+ *
+ * @param handler Called on the owning thread with each block of the latest window
+ */
+void ModelLoader::setBlockHandler(std::function<void(Block &)> handler) {
+    m_blockHandler = handler;
+}
+
+/**
+ * @brief Queue a block read from the window of the latest request
+ *
+ * The block is dropped if the window has been replaced by the time it is
+ * read or delivered.
+ *
+ * @param block Block number
+ */
+void ModelLoader::fetchBlock(int block) {
+    const quint64 generation = m_latest;
+    QMetaObject::invokeMethod(m_worker, [this, generation, block]() {
+        loadBlock(generation, block);
+    }, Qt::QueuedConnection);
+}
+
+/**
+ * @brief Run a load request on the worker thread
+ *
+ * Any window left open by an earlier request is closed first. When paging,
+ * only the first page is loaded unless a record is to be located, in which
+ * case its position is found first and the pages through that position are
+ * loaded in one query. When windowed, a scroll cursor is opened instead and
+ * only the block holding the located record, or the first block, is read.
+ *
+ * @param generation Generation of the request
+ * @param request Description of the load
+ */
+void ModelLoader::load(quint64 generation, const Request &request) {
+    if (generation != m_latest)
+        return;
+    closeWindow();
+
+    const TableSchema *table = request.table;
+    const int keyIndex = table->plan().primaryKey;
+    const int sortIndex = table->ordinal(request.sortColumn, true);
+    const QVariantMap values = table->filterValues(request.filters);
+    Result result { RowStore(table->columns(), true, request.projection) };
+
+    // Lease connection for this thread
+    std::shared_ptr<ConnectionPool> pool = ConnectionPool::forConnection(m_sourceName);
+    ConnectionLease lease = pool ? pool->acquire() : ConnectionLease();
+    if (!lease.isValid()) {
+        result.error = "loader connection unavailable";
+        QMetaObject::invokeMethod(this, [this, generation, result = std::move(result)]() mutable { deliver(generation, result); }, Qt::QueuedConnection);
+        return;
+    }
+    QSqlDatabase db = lease.database();
+
+    // Take the watermark before the rows so that no later change is missed
+    if (request.readWatermark) {
+        QSqlQuery query(db);
+        query.setForwardOnly(true);
+        if (query.exec(table->watermarkSql()) && query.next())
+            result.watermark = query.value(0).toLongLong();
+        else
+            qDebug() << "failed watermark query:" << query.lastError().text();
+    }
+
+    // Find the position of the record
+    const bool paged = request.pageSize > 0 && !request.windowed;
+    int position = -1;
+    if ((paged || request.windowed) && !request.id.isEmpty()) {
+        QSqlQuery query(db);
+        query.setForwardOnly(true);
+        query.prepare(table->locateSql(request.filters, request.sortColumn, request.sortOrder));
+        for (auto it = values.constBegin(); it != values.constEnd(); ++it)
+            query.bindValue(it.key(), it.value());
+        query.bindValue(":locate_key", request.id);
+        if (query.exec() && query.next())
+            position = query.value(0).toInt();
+    }
+
+    // Open window over the result set, keeping the connection that holds it
+    if (request.windowed) {
+        openWindow(generation, request, lease, position, result);
+        QMetaObject::invokeMethod(this, [this, generation, result = std::move(result)]() mutable { deliver(generation, result); }, Qt::QueuedConnection);
+        return;
+    }
+
+    // Find how many pages are needed to reach the record
+    int limit = request.pageSize;
+    if (paged && position >= 0)
+        limit = (position / request.pageSize + 1) * request.pageSize;
+
+    // Load whole result set or the pages through the record
+    const QString sql = paged
+        ? table->selectSql(request.filters, request.sortColumn, request.sortOrder, KeysetCursor(), limit, true, request.projection)
+        : table->selectSql(request.filters, request.sortColumn, request.sortOrder, true, request.projection);
+    QSqlQuery query(db);
+    query.setForwardOnly(true);
+    query.prepare(sql);
+    for (auto it = values.constBegin(); it != values.constEnd(); ++it)
+        query.bindValue(it.key(), it.value());
+    if (!query.exec()) {
+        qDebug() << sql;
+        result.error = "failed query:" + query.lastError().text();
+    }
+    while (query.next()) {
+        result.rows.append(query);
+        const int row = result.rows.rowCount() - 1;
+        if (result.foundIdx < 0 && !request.id.isEmpty() && result.rows.text(row, keyIndex) == request.id)
+            result.foundIdx = row;
+        if (paged)
+            result.cursor = { table->sortValue(request.sortColumn, result.rows.value(row, sortIndex)), result.rows.value(row, keyIndex), true };
+    }
+    result.atEnd = !paged || result.rows.rowCount() < limit;
+
+    // Hand rows back to the owning thread
+    QMetaObject::invokeMethod(this, [this, generation, result = std::move(result)]() mutable { deliver(generation, result); }, Qt::QueuedConnection);
+}
+
+/**
+ * @brief Declare a scroll cursor and read the block holding the located record
+ *
+ * The cursor is declared WITH HOLD so that it survives the implicit
+ * transaction commit and can be read from at any position later, which
+ * materializes the result set on the server. Moving to the end of the
+ * cursor then gives the total row count. The lease is kept while the
+ * window is open, since the cursor only exists on its connection.
+ *
+ * @param generation Generation of the request
+ * @param request Description of the load
+ * @param lease Lease of the connection the cursor is declared on, taken over on success
+ * @param position Position of the located record or -1
+ * @param result Returns the row count, the block read and its rows
+ * @returns True if successful, otherwise false
+ */
+bool ModelLoader::openWindow(quint64 generation, const Request &request, ConnectionLease &lease, int position, Result &result) {
+    QSqlQuery query(lease.database());
+
+    if (!query.exec(QString("DECLARE %1 SCROLL CURSOR WITH HOLD FOR %2").arg(request.cursorName, request.cursorSql))) {
+        qDebug() << request.cursorSql;
+        result.error = "failed cursor declare:" + query.lastError().text();
+        return false;
+    }
+    m_windowLease = std::move(lease);
+    m_window = request;
+    m_windowGeneration = generation;
+
+    // Count rows in result set
+    if (!query.exec(QString("MOVE FORWARD ALL IN %1").arg(request.cursorName))) {
+        result.error = "failed cursor count:" + query.lastError().text();
+        closeWindow();
+        return false;
+    }
+    result.rowCount = query.numRowsAffected();
+    result.blockSize = request.blockSize;
+    result.foundIdx = position < result.rowCount ? position : -1;
+    result.block = result.foundIdx >= 0 ? result.foundIdx / request.blockSize : 0;
+    if (result.rowCount > 0 && !readBlock(result.block, result.rows, result.error)) {
+        closeWindow();
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Read a block of the open window on the worker thread
+ *
+ * @param generation Generation of the request whose window is read
+ * @param block Block number
+ */
+void ModelLoader::loadBlock(quint64 generation, int block) {
+    if (generation != m_latest || generation != m_windowGeneration || !m_windowLease.isValid())
+        return;
+
+    Block result { block, RowStore(m_window.table->columns(), true, m_window.projection) };
+    readBlock(block, result.rows, result.error);
+    QMetaObject::invokeMethod(this, [this, generation, result = std::move(result)]() mutable { deliverBlock(generation, result); }, Qt::QueuedConnection);
+}
+
+/**
+ * @brief Read block of rows from the scroll cursor
+ *
+ * @param block Block number
+ * @param rows Store the rows are appended to
+ * @param error Returns error text on failure
+ * @returns True if successful, otherwise false
+ */
+bool ModelLoader::readBlock(int block, RowStore &rows, QString &error) {
+    const int blockSize = m_window.blockSize;
+    QSqlQuery query(m_windowLease.database());
+
+    // Position cursor before the first row of the block and read the block
+    query.setForwardOnly(true);
+    if (!query.exec(QString("MOVE ABSOLUTE %1 IN %2").arg(block * blockSize).arg(m_window.cursorName))) {
+        error = "failed cursor move:" + query.lastError().text();
+        return false;
+    }
+    if (!query.exec(QString("FETCH FORWARD %1 FROM %2").arg(blockSize).arg(m_window.cursorName))) {
+        error = "failed cursor fetch:" + query.lastError().text();
+        return false;
+    }
+    rows.reserve(blockSize);
+    while (query.next())
+        rows.append(query);
+    return true;
+}
+
+/**
+ * @brief Close the open window and return its connection
+ */
+void ModelLoader::closeWindow() {
+    if (!m_windowLease.isValid())
+        return;
+    QSqlQuery query(m_windowLease.database());
+    if (!query.exec(QString("CLOSE %1").arg(m_window.cursorName)))
+        qDebug() << m_window.cursorName << "close failed:" << query.lastError().text();
+    query = QSqlQuery();
+    m_windowLease.release();
+    m_windowGeneration = 0;
+}
+
+/**
+ * @brief Deliver a block on the owning thread
+ *
+ * Blocks of superseded windows are discarded.
+ *
+ * @param generation Generation of the request whose window was read
+ * @param block Block read
+ */
+void ModelLoader::deliverBlock(quint64 generation, Block &block) {
+    if (generation != m_latest || !m_blockHandler)
+        return;
+    m_blockHandler(block);
+}
+
+/**
+ * @brief Deliver a result on the owning thread
+ *
+ * Results of superseded requests are discarded.
+ *
+ * @param generation Generation of the request
+ * @param result Rows produced by the request
+ */
+void ModelLoader::deliver(quint64 generation, Result &result) {
+    if (generation != m_latest)
+        return;
+    m_delivered = generation;
+    m_handler(result);
+}
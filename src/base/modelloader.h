@@ -0,0 +1,78 @@
+#ifndef MODELLOADER_H
+#define MODELLOADER_H
+
+#include <QObject>
+#include <QThread>
+#include <atomic>
+#include <functional>
+#include "connectionpool.h"
+#include "rowstore.h"
+#include "tableschema.h"
+
+class ModelLoader : public QObject
+{
+    Q_OBJECT
+public:
+    struct Request {                                // Description of a model load
+        const TableSchema *table = nullptr;         // Table to be loaded
+        QList<FilterCondition> filters;             // Filters applied to the load
+        QString sortColumn;                         // Sort column alias
+        Qt::SortOrder sortOrder = Qt::AscendingOrder; // Sort direction
+        int pageSize = 0;                           // Rows per page, 0 to load the whole table
+        QString id;                                 // Id of record to be located
+        QList<int> projection;                      // Indexes of columns to be loaded, all columns when empty
+        bool readWatermark = false;                 // True to read the watermark before the rows
+        bool windowed = false;                      // True to open a scroll cursor window instead of loading every row
+        QString cursorName;                         // Name of the scroll cursor when windowed
+        QString cursorSql;                          // Select the cursor is declared for, with filter values inlined
+        int blockSize = 200;                        // Rows per block when windowed
+    };
+
+    struct Result {                                 // Rows produced by a model load
+        RowStore rows;                              // Loaded rows
+        KeysetCursor cursor;                        // Position of last loaded row when paging
+        bool atEnd = true;                          // True when all pages have been loaded
+        int foundIdx = -1;                          // Index to located record or -1 if not found
+        qint64 watermark = -1;                      // Watermark taken before the rows were read, -1 if not read
+        int rowCount = 0;                           // Rows in the window when windowed
+        int block = -1;                             // Block held by rows when windowed, otherwise -1
+        int blockSize = 0;                          // Rows per block when windowed
+        QString error;                              // Error text, blank if successful
+    };
+
+    struct Block {                                  // Rows read from an open window
+        int block = -1;                             // Block number
+        RowStore rows;                              // Rows of the block
+        QString error;                              // Error text, blank if successful
+    };
+
+    explicit ModelLoader(const QString &connectionName, std::function<void(Result &)> handler, QObject *parent = nullptr);
+    ~ModelLoader() override;
+
+    void submit(const Request &request);
+    bool isLoading() const;
+    void setBlockHandler(std::function<void(Block &)> handler);
+    void fetchBlock(int block);
+
+private:
+    void load(quint64 generation, const Request &request);
+    bool openWindow(quint64 generation, const Request &request, ConnectionLease &lease, int position, Result &result);
+    void loadBlock(quint64 generation, int block);
+    bool readBlock(int block, RowStore &rows, QString &error);
+    void closeWindow();
+    void deliver(quint64 generation, Result &result);
+    void deliverBlock(quint64 generation, Block &block);
+
+    QString m_sourceName;                           // Connection whose pool is used on the worker thread
+    std::function<void(Result &)> m_handler;        // Called on the owning thread with the latest result
+    std::function<void(Block &)> m_blockHandler;    // Called on the owning thread with each block of the latest window
+    QThread m_thread;                               // Worker thread
+    QObject *m_worker;                              // Context for work run on the worker thread
+    std::atomic<quint64> m_latest { 0 };            // Generation of the latest request
+    quint64 m_delivered = 0;                        // Generation of the last delivered result
+    ConnectionLease m_windowLease;                  // Connection holding the open scroll cursor, worker thread only
+    Request m_window;                               // Request that opened the window, worker thread only
+    quint64 m_windowGeneration = 0;                 // Generation of the request that opened the window, worker thread only
+};
+
+#endif // MODELLOADER_H
@@ -0,0 +1,147 @@
+#include "rowblockcache.h"
+
+/**
+ * @brief Row block cache constructor
+ *
+ * The cache holds fixed size blocks of rows and keeps at most the budgeted
+ * number of blocks resident, discarding the least recently used block first.
+ *
+ * @param blockSize Number of rows in each block
+ * @param blockBudget Maximum number of blocks kept in memory
+ */
+RowBlockCache::RowBlockCache(int blockSize, int blockBudget) {
+    m_blockSize = qMax(1, blockSize);
+    m_blockBudget = qMax(1, blockBudget);
+}
+
+/**
+ * @brief Discard all resident blocks
+ */
+void RowBlockCache::clear() {
+    m_blocks.clear();
+    m_recent.clear();
+}
+
+/**
+ * @brief Block size getter
+ *
+ * @returns Number of rows in each block
+ */
+int RowBlockCache::blockSize() const {
+    return m_blockSize;
+}
+
+/**
+ * @brief Block budget getter
+ *
+ * @returns Maximum number of blocks kept in memory
+ */
+int RowBlockCache::blockBudget() const {
+    return m_blockBudget;
+}
+
+/**
+ * @brief Block size setter
+ *
+ * Changing the block size invalidates all resident blocks.
+ *
+ * @param blockSize Number of rows in each block
+ */
+void RowBlockCache::setBlockSize(int blockSize) {
+    blockSize = qMax(1, blockSize);
+    if (m_blockSize != blockSize) {
+        m_blockSize = blockSize;
+        clear();
+    }
+}
+
+/**
+ * @brief Block budget setter
+ *
+ * @param blockBudget Maximum number of blocks kept in memory
+ */
+void RowBlockCache::setBlockBudget(int blockBudget) {
+    m_blockBudget = qMax(1, blockBudget);
+    evict();
+}
+
+/**
+ * @brief Get block number holding a row
+ *
+ * @param row Row number
+ * @returns Block number
+ */
+int RowBlockCache::blockOf(int row) const {
+    return row / m_blockSize;
+}
+
+/**
+ * @brief Determine if block is resident
+ *
+ * @param block Block number
+ * @returns True when block is in memory, otherwise false
+ */
+bool RowBlockCache::contains(int block) const {
+    return m_blocks.contains(block);
+}
+
+/**
+ * @brief Retrieve a resident block
+ *
+ * The block becomes the most recently used block.
+ *
+ * @param block Block number
+ * @returns Pointer to rows of the block or nullptr when the block is not resident
+ */
+const RowStore *RowBlockCache::block(int block) {
+    auto it = m_blocks.constFind(block);
+    if (it == m_blocks.constEnd())
+        return nullptr;
+
+    if (m_recent.last() != block) {
+        m_recent.removeOne(block);
+        m_recent.append(block);
+    }
+    return &it.value();
+}
+
+/**
+ * @brief Add block to cache
+ *
+ * The block becomes the most recently used block. Least recently used
+ * blocks are discarded until the cache is within its budget.
+ *
+ * @param block Block number
+ * @param rows Rows of the block
+ */
+void RowBlockCache::insert(int block, const RowStore &rows) {
+    m_blocks.insert(block, rows);
+    m_recent.removeOne(block);
+    m_recent.append(block);
+    evict();
+}
+
+/**
+ * @brief Find a row among the resident blocks
+ *
+ * @param column Column index compared
+ * @param text Text value of the column
+ * @returns Row number of the first match or -1 if no resident row matches
+ */
+int RowBlockCache::find(int column, const QString &text) const {
+    for (auto it = m_blocks.constBegin(); it != m_blocks.constEnd(); ++it) {
+        for (int row = 0; row < it.value().rowCount(); ++row) {
+            if (it.value().text(row, column) == text)
+                return it.key() * m_blockSize + row;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Discard least recently used blocks until within budget
+ */
+void RowBlockCache::evict() {
+    while (m_recent.size() > m_blockBudget)
+        m_blocks.remove(m_recent.takeFirst());
+}
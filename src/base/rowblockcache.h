@@ -0,0 +1,34 @@
+#ifndef ROWBLOCKCACHE_H
+#define ROWBLOCKCACHE_H
+
+#include <QHash>
+#include <QList>
+#include "rowstore.h"
+
+class RowBlockCache
+{
+public:
+    explicit RowBlockCache(int blockSize = 200, int blockBudget = 16);
+
+    void clear();
+    int blockSize() const;
+    int blockBudget() const;
+    void setBlockSize(int blockSize);
+    void setBlockBudget(int blockBudget);
+
+    int blockOf(int row) const;
+    bool contains(int block) const;
+    const RowStore *block(int block);
+    void insert(int block, const RowStore &rows);
+    int find(int column, const QString &text) const;
+
+private:
+    void evict();
+
+    int m_blockSize;                                // Rows held by each block
+    int m_blockBudget;                              // Maximum number of resident blocks
+    QHash<int, RowStore> m_blocks;                  // Resident blocks keyed by block number
+    QList<int> m_recent;                            // Block numbers, least recently used first
+};
+
+#endif // ROWBLOCKCACHE_H
@@ -0,0 +1,599 @@
+#include "rowstore.h"
+#include <QCollator>
+#include <QDate>
+#include <QSqlQuery>
+#include <algorithm>
+#include <numeric>
+
+/**
+ * @brief Row store constructor
+ *
+ * Rows are held column by column using a storage type derived from the logical
+ * type of each column. Text is kept in a single UTF-16 arena per column and only
+ * converted to a QString when it is requested, so a loaded row costs little more
+ * than the data it holds.
+ *
+ * Columns keep their schema index whether or not they are loaded. When a
+ * projection is given only those columns are loaded, selected in ascending
+ * index order; the others hold no data and read as null until filled. All
+ * stores whose rows are combined must share the same projection.
+ *
+ * Enumerated values are stored as integers. When labels are used they are
+ * decoded to their label for display and compared in label order.
+ *
+ * @param columns Column definitions in schema order
+ * @param useLabels True when enumerated columns are shown as labels
+ * @param projection Indexes of loaded columns in ascending order, all columns when empty
+ */
+RowStore::RowStore(const QList<ColumnDefinition> &columns, bool useLabels, const QList<int> &projection) {
+    m_columns.reserve(columns.size());
+    for (int i = 0; i < columns.size(); ++i) {
+        const ColumnDefinition &column = columns.at(i);
+        Column storage;
+        storage.type = column.type;
+        storage.position = projection.isEmpty() ? i : projection.indexOf(i);
+        if (useLabels && column.constraint && column.constraint->type == ConstraintType::EnumSet)
+            storage.labels = std::make_shared<const EnumLabels>(static_cast<const EnumConstraint &>(*column.constraint));
+        switch (column.type) {
+            case ColumnType::String:
+                storage.storage = column.sqlType == "UUID" ? Storage::Uuid : Storage::Text;
+                break;
+            case ColumnType::Int:       storage.storage = Storage::Integer; break;
+            case ColumnType::Date:      storage.storage = Storage::Date;    break;
+            case ColumnType::Currency:
+            case ColumnType::Float:     storage.storage = Storage::Real;    break;
+        }
+        if (storage.storage == Storage::Text && storage.position >= 0)
+            storage.offsets << 0;
+        m_columns << storage;
+    }
+}
+
+/**
+ * @brief Discard all rows
+ */
+void RowStore::clear() {
+    for (Column &column : m_columns) {
+        column.nulls.clear();
+        column.integers.clear();
+        column.reals.clear();
+        column.uuids.clear();
+        column.arena.clear();
+        column.offsets.clear();
+        if (column.storage == Storage::Text && column.position >= 0)
+            column.offsets << 0;
+    }
+    m_rowCount = 0;
+}
+
+/**
+ * @brief Reserve space for rows
+ *
+ * @param rows Number of rows expected
+ */
+void RowStore::reserve(int rows) {
+    for (Column &column : m_columns) {
+        if (column.position < 0)
+            continue;
+        column.nulls.reserve(rows);
+        switch (column.storage) {
+        case Storage::Text:     column.offsets.reserve(rows + 1);   break;
+        case Storage::Uuid:     column.uuids.reserve(rows);         break;
+        case Storage::Integer:
+        case Storage::Date:     column.integers.reserve(rows);      break;
+        case Storage::Real:     column.reals.reserve(rows);         break;
+        }
+    }
+}
+
+/**
+ * @brief Get number of rows stored
+ *
+ * @returns Number of rows
+ */
+int RowStore::rowCount() const {
+    return m_rowCount;
+}
+
+/**
+ * @brief Get number of columns stored
+ *
+ * @returns Number of columns
+ */
+int RowStore::columnCount() const {
+    return m_columns.size();
+}
+
+/**
+ * @brief Get physical storage of column
+ *
+ * @param column Column index
+ * @returns Storage type
+ */
+RowStore::Storage RowStore::storage(int column) const {
+    return m_columns.at(column).storage;
+}
+
+/**
+ * @brief Get indexes of loaded columns
+ *
+ * @returns Column indexes in ascending order
+ */
+QList<int> RowStore::projection() const {
+    QList<int> columns;
+    for (int i = 0; i < m_columns.size(); ++i) {
+        if (m_columns.at(i).position >= 0)
+            columns << i;
+    }
+    return columns;
+}
+
+/**
+ * @brief Determine if a column is loaded
+ *
+ * @param column Column index
+ * @returns True if loaded, otherwise false
+ */
+bool RowStore::isLoaded(int column) const {
+    return m_columns.at(column).position >= 0;
+}
+
+/**
+ * @brief Load a column that was left out of the projection
+ *
+ * @param column Column index
+ * @param values Value of every stored row, in row order
+ */
+void RowStore::fill(int column, const QVariantList &values) {
+    Column &col = m_columns[column];
+    col.nulls.clear();
+    col.integers.clear();
+    col.reals.clear();
+    col.uuids.clear();
+    col.arena.clear();
+    col.offsets.clear();
+    if (col.storage == Storage::Text)
+        col.offsets << 0;
+    for (int row = 0; row < m_rowCount; ++row)
+        append(column, row < values.size() ? values.at(row) : QVariant());
+
+    // Renumber select list positions to include the column
+    col.position = 0;
+    int position = 0;
+    for (Column &loaded : m_columns) {
+        if (loaded.position >= 0)
+            loaded.position = position++;
+    }
+}
+
+/**
+ * @brief Append current row of a query
+ *
+ * Values are read by position, so the select list must hold the loaded
+ * columns in ascending index order.
+ *
+ * @param query Query positioned on a valid row
+ */
+void RowStore::append(const QSqlQuery &query) {
+    for (int i = 0; i < m_columns.size(); ++i) {
+        if (m_columns.at(i).position >= 0)
+            append(i, query.value(m_columns.at(i).position));
+    }
+    m_rowCount += 1;
+}
+
+/**
+ * @brief Append a single value to a column
+ *
+ * The row count is not changed, so every loaded column must be appended to.
+ *
+ * @param column Column index
+ * @param value Value to be appended
+ */
+void RowStore::append(int column, const QVariant &value) {
+    Column &col = m_columns[column];
+    const bool null = value.isNull();
+
+    col.nulls << null;
+    switch (col.storage) {
+    case Storage::Text:
+        if (!null)
+            col.arena.append(value.toString());
+        col.offsets << col.arena.size();
+        break;
+    case Storage::Uuid:
+        col.uuids << (null ? QUuid() : QUuid::fromString(value.toString()));
+        break;
+    case Storage::Integer:
+        col.integers << (null ? 0 : value.toLongLong());
+        break;
+    case Storage::Date:
+        col.integers << (null ? 0 : value.toDate().toJulianDay());
+        break;
+    case Storage::Real:
+        col.reals << (null ? 0.0 : value.toDouble());
+        break;
+    }
+}
+
+/**
+ * @brief Append all rows of another store with the same column layout
+ *
+ * @param other Store whose rows are to be appended
+ */
+void RowStore::append(const RowStore &other) {
+    for (int i = 0; i < m_columns.size(); ++i) {
+        Column &column = m_columns[i];
+        const Column &source = other.m_columns.at(i);
+        if (column.position < 0)
+            continue;
+
+        column.nulls << source.nulls;
+        switch (column.storage) {
+        case Storage::Text:
+        {
+            const int base = column.arena.size();
+            column.arena.append(source.arena);
+            for (int row = 1; row < source.offsets.size(); ++row)
+                column.offsets << base + source.offsets.at(row);
+            break;
+        }
+        case Storage::Uuid:
+            column.uuids << source.uuids;
+            break;
+        case Storage::Integer:
+        case Storage::Date:
+            column.integers << source.integers;
+            break;
+        case Storage::Real:
+            column.reals << source.reals;
+            break;
+        }
+    }
+    m_rowCount += other.m_rowCount;
+}
+
+/**
+ * @brief Insert a row of another store with the same column layout
+ *
+ * Values after the insertion point are shifted, so this is meant for
+ * single-row changes rather than loading.
+ *
+ * @param row Row index at which the row is inserted
+ * @param other Store holding the row
+ * @param otherRow Row index in the other store
+ */
+void RowStore::insert(int row, const RowStore &other, int otherRow) {
+    for (int i = 0; i < m_columns.size(); ++i) {
+        Column &column = m_columns[i];
+        const Column &source = other.m_columns.at(i);
+        if (column.position < 0)
+            continue;
+
+        column.nulls.insert(row, source.nulls.at(otherRow));
+        switch (column.storage) {
+        case Storage::Text:
+        {
+            const int start = source.offsets.at(otherRow);
+            const int length = source.offsets.at(otherRow + 1) - start;
+            column.arena.insert(column.offsets.at(row), QStringView(source.arena).mid(start, length));
+            column.offsets.insert(row + 1, column.offsets.at(row) + length);
+            for (int next = row + 2; next < column.offsets.size(); ++next)
+                column.offsets[next] += length;
+            break;
+        }
+        case Storage::Uuid:
+            column.uuids.insert(row, source.uuids.at(otherRow));
+            break;
+        case Storage::Integer:
+        case Storage::Date:
+            column.integers.insert(row, source.integers.at(otherRow));
+            break;
+        case Storage::Real:
+            column.reals.insert(row, source.reals.at(otherRow));
+            break;
+        }
+    }
+    m_rowCount += 1;
+}
+
+/**
+ * @brief Remove a row
+ *
+ * @param row Row index
+ */
+void RowStore::remove(int row) {
+    for (Column &column : m_columns) {
+        if (column.position < 0)
+            continue;
+        column.nulls.remove(row);
+        switch (column.storage) {
+        case Storage::Text:
+        {
+            const int length = column.offsets.at(row + 1) - column.offsets.at(row);
+            column.arena.remove(column.offsets.at(row), length);
+            column.offsets.remove(row + 1);
+            for (int next = row + 1; next < column.offsets.size(); ++next)
+                column.offsets[next] -= length;
+            break;
+        }
+        case Storage::Uuid:
+            column.uuids.remove(row);
+            break;
+        case Storage::Integer:
+        case Storage::Date:
+            column.integers.remove(row);
+            break;
+        case Storage::Real:
+            column.reals.remove(row);
+            break;
+        }
+    }
+    m_rowCount -= 1;
+}
+
+/**
+ * @brief Replace a row with a row of another store with the same column layout
+ *
+ * @param row Row index to be replaced
+ * @param other Store holding the replacement row
+ * @param otherRow Row index in the other store
+ */
+void RowStore::replace(int row, const RowStore &other, int otherRow) {
+    remove(row);
+    insert(row, other, otherRow);
+}
+
+/**
+ * @brief Reorder the rows
+ *
+ * Each loaded column is gathered once into new storage, so reordering costs
+ * one pass over the stored values.
+ *
+ * @param order Stored row to be placed at each position, a permutation of all rows
+ */
+void RowStore::permute(const QVector<int> &order) {
+    for (Column &column : m_columns) {
+        if (column.position < 0)
+            continue;
+
+        QVector<bool> nulls;
+        nulls.reserve(order.size());
+        for (int row : order)
+            nulls << column.nulls.at(row);
+        column.nulls = std::move(nulls);
+        switch (column.storage) {
+        case Storage::Text:
+        {
+            QString arena;
+            QVector<int> offsets;
+            arena.reserve(column.arena.size());
+            offsets.reserve(order.size() + 1);
+            offsets << 0;
+            for (int row : order) {
+                const int start = column.offsets.at(row);
+                arena.append(QStringView(column.arena).mid(start, column.offsets.at(row + 1) - start));
+                offsets << arena.size();
+            }
+            column.arena = std::move(arena);
+            column.offsets = std::move(offsets);
+            break;
+        }
+        case Storage::Uuid:
+        {
+            QVector<QUuid> uuids;
+            uuids.reserve(order.size());
+            for (int row : order)
+                uuids << column.uuids.at(row);
+            column.uuids = std::move(uuids);
+            break;
+        }
+        case Storage::Integer:
+        case Storage::Date:
+        {
+            QVector<qint64> integers;
+            integers.reserve(order.size());
+            for (int row : order)
+                integers << column.integers.at(row);
+            column.integers = std::move(integers);
+            break;
+        }
+        case Storage::Real:
+        {
+            QVector<double> reals;
+            reals.reserve(order.size());
+            for (int row : order)
+                reals << column.reals.at(row);
+            column.reals = std::move(reals);
+            break;
+        }
+        }
+    }
+}
+
+/**
+ * @brief Determine if value is null
+ *
+ * @param row Row index
+ * @param column Column index
+ * @returns True if null, otherwise false
+ */
+bool RowStore::isNull(int row, int column) const {
+    const Column &col = m_columns.at(column);
+    return col.position < 0 || col.nulls.at(row);
+}
+
+/**
+ * @brief Retrieve value formatted for display
+ *
+ * @param row Row index
+ * @param column Column index
+ * @returns Formatted value or an empty string for null values
+ */
+QString RowStore::text(int row, int column) const {
+    const Column &col = m_columns.at(column);
+
+    if (isNull(row, column))
+        return QString();
+    switch (col.storage) {
+    case Storage::Text:
+    {
+        const int start = col.offsets.at(row);
+        return col.arena.mid(start, col.offsets.at(row + 1) - start);
+    }
+    case Storage::Uuid:
+        return col.uuids.at(row).toString(QUuid::WithoutBraces);
+    case Storage::Integer:
+        if (col.labels)
+            return col.labels->label(col.integers.at(row));
+        return QString::number(col.integers.at(row));
+    case Storage::Date:
+        return QDate::fromJulianDay(col.integers.at(row)).toString(Qt::ISODate);
+    case Storage::Real:
+        return col.type == ColumnType::Currency
+            ? QString::number(col.reals.at(row), 'f', 2)
+            : QString::number(col.reals.at(row));
+    }
+    return QString();
+}
+
+/**
+ * @brief Compare a value with the value of another store with the same column layout
+ *
+ * Nulls compare greater than any value, matching PostgreSQL ascending order.
+ * Text is compared using the locale, which approximates the database collation.
+ * Labeled enumerated values are compared by the rank of their label.
+ *
+ * @param row Row index
+ * @param column Column index
+ * @param other Store holding the value compared against
+ * @param otherRow Row index in the other store
+ * @returns Negative, zero or positive as this value is less than, equal to or greater than the other
+ */
+int RowStore::compare(int row, int column, const RowStore &other, int otherRow) const {
+    const Column &col = m_columns.at(column);
+    const Column &source = other.m_columns.at(column);
+    const bool null = isNull(row, column);
+    const bool otherNull = other.isNull(otherRow, column);
+
+    if (null || otherNull)
+        return int(null) - int(otherNull);
+    switch (col.storage) {
+    case Storage::Text:
+        return QString::localeAwareCompare(text(row, column), other.text(otherRow, column));
+    case Storage::Uuid:
+        return text(row, column).compare(other.text(otherRow, column));
+    case Storage::Integer:
+        if (col.labels) {
+            const int rank = col.labels->rank(col.integers.at(row));
+            const int otherRank = col.labels->rank(source.integers.at(otherRow));
+            return (rank > otherRank) - (rank < otherRank);
+        }
+        Q_FALLTHROUGH();
+    case Storage::Date:
+        return (col.integers.at(row) > source.integers.at(otherRow)) - (col.integers.at(row) < source.integers.at(otherRow));
+    case Storage::Real:
+        return (col.reals.at(row) > source.reals.at(otherRow)) - (col.reals.at(row) < source.reals.at(otherRow));
+    }
+    return 0;
+}
+
+/**
+ * @brief Sort the stored rows in ascending order
+ *
+ * The rows are ordered on a column with nulls last, then on the key column,
+ * matching PostgreSQL ascending order. Reversing the result gives the
+ * descending order. Text is compared through collation keys computed once
+ * per row rather than collating on every comparison, and labeled enumerated
+ * values through the rank of their label.
+ *
+ * @param column Index of column to sort on, must be loaded
+ * @param keyColumn Index of unique column breaking ties, must be loaded
+ * @returns Stored row at each sorted position
+ */
+QVector<int> RowStore::sortedRows(int column, int keyColumn) const {
+    QVector<int> order(m_rowCount);
+    std::iota(order.begin(), order.end(), 0);
+
+    // Precompute collation keys of text values
+    std::vector<QCollatorSortKey> keys;
+    if (m_columns.at(column).storage == Storage::Text) {
+        const QCollator collator;
+        keys.reserve(m_rowCount);
+        for (int row = 0; row < m_rowCount; ++row)
+            keys.push_back(collator.sortKey(text(row, column)));
+    }
+
+    const QVector<bool> &nulls = m_columns.at(column).nulls;
+    std::sort(order.begin(), order.end(), [&](int row, int otherRow) {
+        int result = int(nulls.at(row)) - int(nulls.at(otherRow));
+        if (result == 0 && !nulls.at(row))
+            result = compareStored(column, row, otherRow, keys.empty() ? nullptr : &keys);
+        if (result == 0)
+            result = compareStored(keyColumn, row, otherRow, nullptr);
+        return result < 0;
+    });
+    return order;
+}
+
+/**
+ * @brief Compare two stored values of a column
+ *
+ * @param column Column index
+ * @param row First row index
+ * @param otherRow Second row index
+ * @param keys Collation key of each row for text columns, or nullptr to compare text directly
+ * @returns Negative, zero or positive as the first value is less than, equal to or greater than the second
+ */
+int RowStore::compareStored(int column, int row, int otherRow, const std::vector<QCollatorSortKey> *keys) const {
+    const Column &col = m_columns.at(column);
+    switch (col.storage) {
+    case Storage::Text:
+        if (keys)
+            return keys->at(row).compare(keys->at(otherRow));
+        return QString::localeAwareCompare(text(row, column), text(otherRow, column));
+    case Storage::Uuid:
+        return (col.uuids.at(row) > col.uuids.at(otherRow)) - (col.uuids.at(row) < col.uuids.at(otherRow));
+    case Storage::Integer:
+        if (col.labels) {
+            const int rank = col.labels->rank(col.integers.at(row));
+            const int otherRank = col.labels->rank(col.integers.at(otherRow));
+            return (rank > otherRank) - (rank < otherRank);
+        }
+        Q_FALLTHROUGH();
+    case Storage::Date:
+        return (col.integers.at(row) > col.integers.at(otherRow)) - (col.integers.at(row) < col.integers.at(otherRow));
+    case Storage::Real:
+        return (col.reals.at(row) > col.reals.at(otherRow)) - (col.reals.at(row) < col.reals.at(otherRow));
+    }
+    return 0;
+}
+
+/**
+ * @brief Retrieve typed value
+ *
+ * Identifiers are returned in their text form so they can be bound
+ * directly as query parameters.
+ *
+ * @param row Row index
+ * @param column Column index
+ * @returns Value or a null QVariant
+ */
+QVariant RowStore::value(int row, int column) const {
+    const Column &col = m_columns.at(column);
+
+    if (isNull(row, column))
+        return QVariant();
+    switch (col.storage) {
+    case Storage::Text:
+    case Storage::Uuid:
+        return text(row, column);
+    case Storage::Integer:
+        return col.integers.at(row);
+    case Storage::Date:
+        return QDate::fromJulianDay(col.integers.at(row));
+    case Storage::Real:
+        return col.reals.at(row);
+    }
+    return QVariant();
+}
@@ -0,0 +1,72 @@
+#ifndef ROWSTORE_H
+#define ROWSTORE_H
+
+#include <QCollatorSortKey>
+#include <QList>
+#include <QString>
+#include <QUuid>
+#include <QVariant>
+#include <QVector>
+#include <memory>
+#include <vector>
+#include "tableschema.h"
+
+class QSqlQuery;
+
+class RowStore
+{
+public:
+    enum class Storage {                            // Physical storage used for a column
+        Text,                                       // UTF-16 arena with offsets
+        Uuid,                                       // 128 bit identifiers
+        Integer,                                    // 64 bit integers
+        Real,                                       // Double precision values
+        Date                                        // Julian day numbers
+    };
+
+    explicit RowStore(const QList<ColumnDefinition> &columns = {}, bool useLabels = false, const QList<int> &projection = {});
+
+    void clear();
+    void reserve(int rows);
+    int rowCount() const;
+    int columnCount() const;
+    Storage storage(int column) const;
+    QList<int> projection() const;
+    bool isLoaded(int column) const;
+    void fill(int column, const QVariantList &values);
+
+    void append(const QSqlQuery &query);
+    void append(int column, const QVariant &value);
+    void append(const RowStore &other);
+    void insert(int row, const RowStore &other, int otherRow);
+    void remove(int row);
+    void replace(int row, const RowStore &other, int otherRow);
+    void permute(const QVector<int> &order);
+
+    bool isNull(int row, int column) const;
+    QString text(int row, int column) const;
+    QVariant value(int row, int column) const;
+    int compare(int row, int column, const RowStore &other, int otherRow) const;
+    QVector<int> sortedRows(int column, int keyColumn) const;
+
+private:
+    struct Column {                                 // Storage for a single column
+        Storage storage;                            // Physical storage
+        ColumnType type;                            // Logical type, used for formatting
+        int position = -1;                          // Position in the select list or -1 when not loaded
+        std::shared_ptr<const EnumLabels> labels;   // Label lookup when enumerated values are shown as labels
+        QVector<bool> nulls;                        // True for each null value
+        QVector<qint64> integers;                   // Integer and date values
+        QVector<double> reals;                      // Real values
+        QVector<QUuid> uuids;                       // Identifier values
+        QString arena;                              // Text values stored back to back
+        QVector<int> offsets;                       // Start of each text value in arena followed by the end
+    };
+
+    int compareStored(int column, int row, int otherRow, const std::vector<QCollatorSortKey> *keys) const;
+
+    QVector<Column> m_columns;                      // Column storage in select list order
+    int m_rowCount = 0;                             // Number of rows stored
+};
+
+#endif // ROWSTORE_H
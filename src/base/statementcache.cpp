@@ -0,0 +1,138 @@
+#include "statementcache.h"
+#include <QMutex>
+#include <QMutexLocker>
+#include <QDebug>
+#include <atomic>
+
+namespace {
+QMutex registryMutex;                               // Guards the registry of caches
+QHash<QString, StatementCache *> registry;          // Statement caches by connection name
+std::atomic<int> generation { 0 };                  // Bumped whenever every cache is invalidated
+}
+
+/**
+ * @brief Statement cache constructor
+ *
+ * @param db Database connection on which statements are prepared
+ */
+StatementCache::StatementCache(const QSqlDatabase &db) : m_db(db), m_generation(generation.load()) {
+}
+
+/**
+ * @brief Retrieve the statement cache for a connection
+ *
+ * One cache exists per connection name and lives for the rest of the process.
+ * A cache must only be used from the thread that owns its connection.
+ *
+ * @param db Database connection
+ * @returns Statement cache for the connection
+ */
+StatementCache &StatementCache::forDatabase(const QSqlDatabase &db) {
+    QMutexLocker locker(&registryMutex);
+    StatementCache *&cache = registry[db.connectionName()];
+    if (!cache)
+        cache = new StatementCache(db);
+    return *cache;
+}
+
+/**
+ * @brief Discard the prepared statements of every connection
+ *
+ * This is needed after the database schema has changed. A cache may only be
+ * touched by the thread owning its connection, so each cache discards its
+ * statements the next time that thread prepares one.
+ */
+void StatementCache::invalidateAll() {
+    generation.fetch_add(1);
+}
+
+/**
+ * @brief Drop the statement cache of a connection
+ *
+ * This must be called from the thread owning the connection before
+ * the connection is removed.
+ *
+ * @param connectionName Name of connection
+ */
+void StatementCache::discard(const QString &connectionName) {
+    QMutexLocker locker(&registryMutex);
+    delete registry.take(connectionName);
+}
+
+/**
+ * @brief Retrieve a prepared statement
+ *
+ * The key identifies the table, operation and column-set shape of the statement.
+ * On a miss the Sql is generated and prepared; statements that fail to prepare
+ * are returned so the caller can report the error but are not kept.
+ *
+ * @param key Key identifying the statement
+ * @param sql Generator for the Sql text, only called on a miss
+ * @returns Prepared statement ready for binding and execution
+ */
+std::shared_ptr<QSqlQuery> StatementCache::prepare(const QString &key, const std::function<QString()> &sql) {
+    const int current = generation.load();
+    if (m_generation != current) {
+        m_queries.clear();
+        m_generation = current;
+    }
+
+    auto it = m_queries.constFind(key);
+    if (it != m_queries.constEnd()) {
+        m_hits += 1;
+        return it.value();
+    }
+
+    m_misses += 1;
+    auto query = std::make_shared<QSqlQuery>(m_db);
+    if (query->prepare(sql()))
+        m_queries.insert(key, query);
+    else
+        qDebug() << key << "prepare failed";
+    return query;
+}
+
+/**
+ * @brief Discard prepared statements
+ *
+ * @param prefix Discard only statements whose key starts with this prefix, or all when blank
+ */
+void StatementCache::invalidate(const QString &prefix) {
+    if (prefix.isEmpty()) {
+        m_queries.clear();
+        return;
+    }
+    for (auto it = m_queries.begin(); it != m_queries.end();) {
+        if (it.key().startsWith(prefix))
+            it = m_queries.erase(it);
+        else
+            ++it;
+    }
+}
+
+/**
+ * @brief Get number of statements reused
+ *
+ * @returns Cache hits
+ */
+int StatementCache::hits() const {
+    return m_hits;
+}
+
+/**
+ * @brief Get number of statements prepared
+ *
+ * @returns Cache misses
+ */
+int StatementCache::misses() const {
+    return m_misses;
+}
+
+/**
+ * @brief Get number of statements held
+ *
+ * @returns Number of cached statements
+ */
+int StatementCache::size() const {
+    return m_queries.size();
+}
@@ -0,0 +1,35 @@
+#ifndef STATEMENTCACHE_H
+#define STATEMENTCACHE_H
+
+#include <QHash>
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QString>
+#include <functional>
+#include <memory>
+
+class StatementCache
+{
+public:
+    static StatementCache &forDatabase(const QSqlDatabase &db);
+    static void invalidateAll();
+    static void discard(const QString &connectionName);
+
+    std::shared_ptr<QSqlQuery> prepare(const QString &key, const std::function<QString()> &sql);
+    void invalidate(const QString &prefix = QString());
+
+    int hits() const;
+    int misses() const;
+    int size() const;
+
+private:
+    explicit StatementCache(const QSqlDatabase &db);
+
+    QSqlDatabase m_db;                              // Connection the statements are prepared on
+    QHash<QString, std::shared_ptr<QSqlQuery>> m_queries; // Prepared statements by key
+    int m_generation;                               // Invalidation generation the statements were prepared in
+    int m_hits = 0;                                 // Number of statements reused
+    int m_misses = 0;                               // Number of statements prepared
+};
+
+#endif // STATEMENTCACHE_H
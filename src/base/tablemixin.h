@@ -2,7 +2,9 @@
 #define TABLEMIXIN_H
 
 #include <QSqlDatabase>
+#include <functional>
 #include "base/tableschema.h"
+#include "base/unitofwork.h"
 
 template <typename Derived>
 class TableMixin {
@@ -23,10 +25,15 @@ protected:
     bool success(const QString &message, const QString &id) {
         m_error = "";
         qInfo() << m_table->tableName() + " " + message + " " + id;
-        if (!m_quiet) static_cast<Derived*>(this)->emitSuccess(message, id);
+        if (!m_quiet) defer([this, message, id]() { static_cast<Derived*>(this)->emitSuccess(message, id); });
         return true;
     }
 
+    // Send a notification now, or once the unit of work on the connection commits
+    void defer(const std::function<void()> &notify) {
+        UnitOfWork::forDatabase(m_db).defer(static_cast<Derived*>(this), notify);
+    }
+
     QSqlDatabase m_db;                              // Database object where tables are located
     TableSchema *m_table;                           // Table being managed
     QString m_error;                                // Last error encountered
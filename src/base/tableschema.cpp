@@ -1,5 +1,9 @@
 #include <QDate>
 #include <QRegularExpression>
+#include <algorithm>
+#include <functional>
+#include <thread>
+#include <vector>
 #include "tableschema.h"
 
 /**
@@ -22,6 +26,8 @@ TableSchema::TableSchema(const QString &tableName, const QString &alias, QObject
  */
 void TableSchema::addColumn(const ColumnDefinition &column) {
     m_columns.append(column);
+    m_plan.reset();
+    emit schemaChanged();
 }
 
 /**
@@ -31,6 +37,158 @@ void TableSchema::addColumn(const ColumnDefinition &column) {
  */
 void TableSchema::addForeignKey(const ForeignKey &fk) {
     m_foreignKeys.append(fk);
+    emit schemaChanged();
+}
+
+/**
+ * @brief Add index definition to table schema
+ *
+ * @param index Index property values
+ */
+void TableSchema::addIndex(const IndexDefinition &index) {
+    m_indexes.append(index);
+    emit schemaChanged();
+}
+
+/**
+ * @brief Add unique key to table schema
+ *
+ * The key is enforced by a unique index. Once the index has been built,
+ * upserts matching on exactly these columns use INSERT ... ON CONFLICT
+ * against it. The index cannot be built while rows duplicate the key, and
+ * until the duplicates are resolved by hand upserts keep using MERGE.
+ *
+ * @param columns Names of the key columns
+ */
+void TableSchema::addUniqueKey(const QStringList &columns) {
+    IndexDefinition index;
+    index.columns = columns;
+    index.isUnique = true;
+    index.name = QString("uq_%1_%2").arg(tableName(true), columns.join("_")).left(63);
+    m_uniqueKeys << columns;
+    addIndex(index);
+}
+
+/**
+ * @brief Drop an index that is no longer declared
+ *
+ * Indexes declared by earlier versions of the schema remain in existing
+ * databases, and are maintained on every write, until they are dropped.
+ *
+ * @param name Name of index
+ */
+void TableSchema::dropIndex(const QString &name) {
+    m_droppedIndexes << name;
+}
+
+/**
+ * @brief Get names of indexes to be dropped
+ *
+ * @returns Index names
+ */
+QStringList TableSchema::droppedIndexes() const {
+    return m_droppedIndexes;
+}
+
+/**
+ * @brief Determine if columns form a unique key whose index is built
+ *
+ * @param columns Column names or aliases, in any order
+ * @returns True if the columns are exactly a unique key with a valid index, otherwise false
+ */
+bool TableSchema::isUniqueKey(const QStringList &columns) const {
+    QStringList names;
+    for (const QString &column : columns)
+        names << toName(column);
+    names.sort();
+    for (QStringList key : m_builtKeys) {
+        key.sort();
+        if (key == names)
+            return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Record whether the index of a unique key is built
+ *
+ * This is set while the schema is initialized, before the table is used
+ * from other threads.
+ *
+ * @param columns Names of the key columns, as declared
+ * @param built True if the key's index exists and is valid
+ */
+void TableSchema::setUniqueKeyBuilt(const QStringList &columns, bool built) {
+    if (!m_uniqueKeys.contains(columns))
+        return;
+    m_builtKeys.removeAll(columns);
+    if (built)
+        m_builtKeys << columns;
+}
+
+/**
+ * @brief Enable or disable default indexes on sortable columns
+ *
+ * When enabled, every column other than the primary key and enumerated
+ * columns is indexed together with the primary key, matching the order
+ * used when rows are sorted and paged on the column. Enumerated columns
+ * hold too few distinct values for an index to pay off.
+ *
+ * @param sortIndexes True to index sortable columns
+ */
+void TableSchema::setSortIndexes(bool sortIndexes) {
+    m_sortIndexes = sortIndexes;
+    emit schemaChanged();
+}
+
+/**
+ * @brief Get the indexes of the table
+ *
+ * These are the declared indexes followed by the default indexes. Foreign
+ * key columns and, when enabled, sortable columns are indexed by default
+ * unless a declared index already starts with the column. Every index is
+ * named.
+ *
+ * @returns List of index definitions
+ */
+QList<IndexDefinition> TableSchema::indexes() const {
+    QList<IndexDefinition> indexes = m_indexes;
+    const int keyIndex = plan().primaryKey;
+    const QString key = keyIndex >= 0 ? m_columns.at(keyIndex).name : QString();
+    auto isLeading = [&](const QString &column) {
+        return std::any_of(indexes.cbegin(), indexes.cend(), [&](const IndexDefinition &index) { return index.columns.value(0) == column; });
+    };
+    auto addDefault = [&](const QString &column) {
+        if (column == key || isLeading(column))
+            return;
+        IndexDefinition index;
+        index.columns << column;
+        if (!key.isEmpty())
+            index.columns << key;
+        indexes << index;
+    };
+
+    // Index foreign key columns and sortable columns
+    for (const ForeignKey &fk : m_foreignKeys)
+        addDefault(fk.localColumn);
+    if (m_sortIndexes) {
+        for (const ColumnDefinition &column : m_columns) {
+            if (!isEnumConstraint(column))
+                addDefault(column.name);
+        }
+    }
+
+    // Name indexes after the table and their columns
+    static const QRegularExpression invalid("[^a-z0-9]+");
+    for (IndexDefinition &index : indexes) {
+        if (!index.name.isEmpty())
+            continue;
+        QString name = QString("idx_%1_%2").arg(tableName(true), index.columns.join("_").toLower().replace(invalid, "_"));
+        if (!index.where.isEmpty())
+            name += QString("_p%1").arg(qChecksum(index.where.toUtf8()), 0, 16);
+        index.name = name.left(63);
+    }
+    return indexes;
 }
 
 /**
@@ -43,6 +201,81 @@ QString TableSchema::tableName(bool forSql) const {
     return forSql ? m_tableName.toLower() : m_tableName;
 }
 
+/**
+ * @brief Enable or disable change notification
+ *
+ * When enabled, createNotifySql() returns a trigger that notifies
+ * listeners of the primary key of each changed row.
+ *
+ * @param notify True to notify changes
+ */
+void TableSchema::setNotifyChanges(bool notify) {
+    m_notifyChanges = notify;
+    emit schemaChanged();
+}
+
+/**
+ * @brief Change notification getter
+ *
+ * @returns True if changes are notified
+ */
+bool TableSchema::notifyChanges() const {
+    return m_notifyChanges;
+}
+
+/**
+ * @brief Name of the channel on which changed keys are notified
+ *
+ * @returns Channel name
+ */
+QString TableSchema::notifyChannel() const {
+    return tableName(true) + "_changed";
+}
+
+/**
+ * @brief Enable or disable row versioning
+ *
+ * When enabled, createVersionSql() adds a row_version column holding the
+ * transaction that last changed each row, and a tombstone table holding
+ * the keys of deleted rows, so that changes since a watermark can be read.
+ *
+ * @param versioning True to version rows
+ */
+void TableSchema::setRowVersioning(bool versioning) {
+    m_rowVersioning = versioning;
+    emit schemaChanged();
+}
+
+/**
+ * @brief Row versioning getter
+ *
+ * @returns True if rows are versioned
+ */
+bool TableSchema::rowVersioning() const {
+    return m_rowVersioning;
+}
+
+/**
+ * @brief Set how long the keys of deleted rows are kept
+ *
+ * Changes can only be read from a watermark younger than the horizon,
+ * older watermarks need the rows loaded again.
+ *
+ * @param seconds Seconds the keys of deleted rows are kept
+ */
+void TableSchema::setTombstoneHorizon(int seconds) {
+    m_tombstoneHorizon = qMax(60, seconds);
+}
+
+/**
+ * @brief Tombstone horizon getter
+ *
+ * @returns Seconds the keys of deleted rows are kept
+ */
+int TableSchema::tombstoneHorizon() const {
+    return m_tombstoneHorizon;
+}
+
 /**
  * @brief Table columns getter
  *
@@ -52,6 +285,45 @@ const QList<ColumnDefinition> &TableSchema::columns() const {
     return m_columns;
 }
 
+/**
+ * @brief Compiled schema plan getter
+ *
+ * The plan must have been compiled by compilePlan() once the schema was
+ * defined, so it can be read from any thread without further locking.
+ *
+ * @returns Precomputed column lookups
+ */
+const SchemaPlan &TableSchema::plan() const {
+    Q_ASSERT_X(m_plan, "TableSchema::plan", "compilePlan() has not been called");
+    return *m_plan;
+}
+
+/**
+ * @brief Compile column lookups into an immutable plan
+ *
+ * This is called once the schema has been fully defined so that alias,
+ * placeholder and title lists are not rebuilt on every lookup. Adding a
+ * column discards the plan, which must then be compiled again.
+ */
+void TableSchema::compilePlan() {
+    auto plan = std::make_shared<SchemaPlan>();
+
+    plan->aliases = columnAliases(true, false);
+    plan->labelAliases = columnAliases(true, true);
+    plan->fields = columnNames(true, false);
+    plan->placeholders = columnPlaceholders(true);
+    plan->titles = columnTitles(true);
+    for (int i = 0; i < m_columns.size(); ++i) {
+        plan->ordinals.insert(plan->aliases.at(i), i);
+        plan->labelOrdinals.insert(plan->labelAliases.at(i), i);
+        if (m_columns.at(i).isPrimaryKey && plan->primaryKey < 0)
+            plan->primaryKey = i;
+        auto constraint = std::dynamic_pointer_cast<EnumConstraint>(m_columns.at(i).constraint);
+        plan->enumLabels << (constraint ? std::make_shared<const EnumLabels>(*constraint) : nullptr);
+    }
+    m_plan = plan;
+}
+
 /**
  * @brief Initialize empty result variant map with default values for each field
  *
@@ -126,21 +398,20 @@ QStringList TableSchema::columnAliases(bool includePrimary, bool useLabels) cons
  *
  * This retrieves the list of columns returning each columns select expression. The expression is
  * constructed as "TableAlias.ColumnName AS TableAlias_ColumnName" for each column. If the use labels
- * option is set, and the column is an enumerated column, the column expression will be a CASE statement
- * that returns the label of the enumerated value with the AS clause as the name of the column.
+ * option is set, and the column is an enumerated column, the enumerated value is selected under the
+ * label alias. The value is decoded to its label by the client through SchemaPlan::enumLabels.
  *
  * @param includePrimary When true, primary field is included, otherwise the primary key will not be in the result set.
- * @param useLabels When true, enumerated column expressions will return a label based on the enumerated value.
+ * @param useLabels When true, enumerated columns are selected under their label alias.
  * @returns QString list of column expressions and their aliases
  */
 QStringList TableSchema::columnFields(bool includePrimary, bool useLabels) const {
     QStringList names;
     for (const ColumnDefinition &column : m_columns) {
         if (includePrimary || !column.isPrimaryKey) {
-            if (useLabels && isEnumConstraint(column)) {
-                auto constraint = std::dynamic_pointer_cast<EnumConstraint>(column.constraint);
-                names << QString("%1 AS %2_%3_label").arg(enumClause(column.name, *constraint), m_alias, column.name);
-            } else
+            if (useLabels && isEnumConstraint(column))
+                names << QString("%1.%2 AS %1_%2_label").arg(m_alias, column.name);
+            else
                 names << QString("%1.%2 AS %1_%2").arg(m_alias, column.name);
         }
     }
@@ -151,24 +422,19 @@ QStringList TableSchema::columnFields(bool includePrimary, bool useLabels) const
  * @brief Column names getter
  *
  * This retrieves the list of columns returning each columns select expression. The expression is
- * constructed as "TableAlias.ColumnName" for each column. If the use labels option is set, and the
- * column is an enumerated column, the column expression will be a CASE statement
- * that returns the label of the enumerated value.
+ * constructed as "TableAlias.ColumnName" for each column. Enumerated columns are always selected
+ * as their value, labels are decoded by the client.
  *
  * @param includePrimary When true, primary field is included, otherwise the primary key will not be in the result set.
- * @param useLabels When true, enumerated column expressions will return a label based on the enumerated value.
+ * @param useLabels Unused, enumerated columns are selected as values either way.
  * @returns QString list of column expressions
  */
 QStringList TableSchema::columnNames(bool includePrimary, bool useLabels) const {
+    Q_UNUSED(useLabels)
     QStringList names;
     for (const ColumnDefinition &column : m_columns) {
-        if (includePrimary || !column.isPrimaryKey) {
-            if (useLabels && isEnumConstraint(column)) {
-                auto constraint = std::dynamic_pointer_cast<EnumConstraint>(column.constraint);
-                names << enumClause(column.name, *constraint);
-            } else
-                names << QString("%1.%2").arg(m_alias, column.name);
-        }
+        if (includePrimary || !column.isPrimaryKey)
+            names << QString("%1.%2").arg(m_alias, column.name);
     }
     return names;
 }
@@ -244,6 +510,37 @@ QVariantMap TableSchema::columnValues(const QString &alias) const {
     return emptyList;
 }
 
+/**
+ * @brief Filter values getter
+ *
+ * Filter values are never inlined into generated Sql. The where clause uses
+ * one placeholder per condition, named ":filter_N" after the position of the
+ * condition, so statements for the same filter columns and operators can be
+ * prepared once and executed with any values. Values for the In operator are
+ * bound as a single PostgreSQL array.
+ *
+ * @param filters Filter structure applied to select
+ * @returns Placeholders and the values to be bound to them
+ */
+QVariantMap TableSchema::filterValues(const QList<FilterCondition> &filters) const {
+    QVariantMap values;
+
+    for (int i = 0; i < filters.size(); ++i) {
+        const FilterCondition &cond = filters.at(i);
+        const QString placeholder = QString(":filter_%1").arg(i);
+
+        if (ordinal(cond.columnName) < 0 || cond.op == FilterOperator::IsNull || cond.op == FilterOperator::IsNotNull)
+            continue;
+        if (cond.op == FilterOperator::In) {
+            const int type = cond.value.userType();
+            const bool isList = type == QMetaType::QVariantList || type == QMetaType::QStringList;
+            values[placeholder] = arrayLiteral(isList ? cond.value.toList() : QVariantList { cond.value });
+        } else
+            values[placeholder] = cond.value;
+    }
+    return values;
+}
+
 /**
  * @brief Get default sort column
  *
@@ -309,6 +606,23 @@ QString TableSchema::toName(const QString alias) const {
     return field;
 }
 
+/**
+ * @brief Get column ordinal from alias
+ *
+ * Column names that are not qualified by the table alias are also accepted.
+ *
+ * @param alias Alias name
+ * @param useLabels True to look up labeled enumerated column aliases
+ * @returns Column ordinal or -1 if not found
+ */
+int TableSchema::ordinal(const QString &alias, bool useLabels) const {
+    const QHash<QString, int> &ordinals = useLabels ? plan().labelOrdinals : plan().ordinals;
+    auto it = ordinals.constFind(alias);
+    if (it == ordinals.constEnd())
+        it = ordinals.constFind(m_alias + "_" + alias);
+    return it == ordinals.constEnd() ? -1 : it.value();
+}
+
 /**
  * @brief Verify that list of column aliases are valid.
  *
@@ -319,7 +633,7 @@ QString TableSchema::toName(const QString alias) const {
  * @returns True when list has all valid column aliases, otherwise false
  */
 bool TableSchema::isAliasListValid(QStringList &nameList, bool useLabels) const {
-    const QStringList allColumns = columnAliases(true, useLabels);
+    const QHash<QString, int> &allColumns = useLabels ? plan().labelOrdinals : plan().ordinals;
 
     for (const auto &alias : nameList) {
         if (!allColumns.contains(alias))
@@ -336,11 +650,77 @@ bool TableSchema::isAliasListValid(QStringList &nameList, bool useLabels) const
  * @returns True when name is a valid column name, otherwise false
  */
 bool TableSchema::isAliasValid(QString &name, bool useLabels) const {
-    const QStringList allColumns = columnAliases(true, useLabels);
+    return (useLabels ? plan().labelOrdinals : plan().ordinals).contains(name);
+}
 
-    if (!allColumns.contains(name))
-        return false;
-    return true;
+/**
+ * @brief Check the values of a row against the column constraints
+ *
+ * Only columns present in the row are checked, so a partial row such as the
+ * changed columns of an update can be validated.
+ *
+ * @param row Variant map containing fields and their associated value
+ * @returns Map of column alias to error text, empty if the row is valid
+ */
+QVariantMap TableSchema::validate(const QVariantMap &row) const {
+    const SchemaPlan &plan = this->plan();
+    QVariantMap errors;
+
+    for (int i = 0; i < m_columns.size(); ++i) {
+        const ColumnDefinition &column = m_columns.at(i);
+        const auto value = row.constFind(plan.aliases.at(i));
+        if (!column.constraint || value == row.constEnd())
+            continue;
+
+        const QString error = column.constraint->check(value.value());
+        if (!error.isEmpty())
+            errors.insert(plan.aliases.at(i), QString("%1: %2").arg(column.title.simplified(), error));
+    }
+    return errors;
+}
+
+/**
+ * @brief Check a batch of rows against the column constraints
+ *
+ * Large batches are split across threads. Constraints are immutable once the
+ * schema is built, so they are shared by every thread without locking.
+ *
+ * @param rows List of variant maps containing fields and their associated value
+ * @returns Map of row number to error text for each invalid row, empty if every row is valid
+ */
+QVariantMap TableSchema::validate(const QVariantList &rows) const {
+    constexpr int rowsPerThread = 2000;
+    const bool isConstrained = std::any_of(m_columns.cbegin(), m_columns.cend(), [](const ColumnDefinition &column) { return column.constraint != nullptr; });
+    if (!isConstrained || rows.isEmpty())
+        return QVariantMap();
+
+    // Check every step'th row starting at first
+    auto checkRows = [&](int first, int step, QVariantMap &errors) {
+        for (int row = first; row < rows.size(); row += step) {
+            const QVariantMap invalid = validate(rows.at(row).toMap());
+            if (invalid.isEmpty())
+                continue;
+
+            QStringList messages;
+            for (const QVariant &message : invalid)
+                messages << message.toString();
+            errors.insert(QString::number(row), messages.join("; "));
+        }
+    };
+
+    const int threadCount = qMax(1, qMin(int(std::thread::hardware_concurrency()), int(rows.size()) / rowsPerThread));
+    std::vector<QVariantMap> found(threadCount);
+    std::vector<std::thread> threads;
+    threads.reserve(threadCount - 1);
+    for (int i = 1; i < threadCount; ++i)
+        threads.emplace_back(checkRows, i, threadCount, std::ref(found[i]));
+    checkRows(0, threadCount, found[0]);
+    for (std::thread &thread : threads)
+        thread.join();
+
+    for (int i = 1; i < threadCount; ++i)
+        found[0].insert(found[i]);
+    return found[0];
 }
 
 /**
@@ -453,6 +833,172 @@ $$;
     return sql.join("\n\n");
 }
 
+/**
+ * @brief Create Sql statements for the change notification trigger
+ *
+ * After each row is inserted, updated or deleted the trigger sends the
+ * server process id of the changing session and the primary key of the row,
+ * as "pid:key", to notifyChannel(). An update that changes the primary key
+ * sends both the old and the new key.
+ *
+ * @returns Sql statements or an empty string if changes are not notified
+ */
+QString TableSchema::createNotifySql() const {
+    const int keyIndex = plan().primaryKey;
+    if (!m_notifyChanges || keyIndex < 0)
+        return QString();
+    const QString key = m_columns.at(keyIndex).name;
+
+    QString sql = QString(R"(
+CREATE OR REPLACE FUNCTION %1_notify() RETURNS trigger AS $$
+BEGIN
+    IF TG_OP <> 'INSERT' THEN
+        PERFORM pg_notify('%2', pg_backend_pid() || ':' || OLD.%3::text);
+    END IF;
+    IF TG_OP = 'INSERT' OR (TG_OP = 'UPDATE' AND NEW.%3 IS DISTINCT FROM OLD.%3) THEN
+        PERFORM pg_notify('%2', pg_backend_pid() || ':' || NEW.%3::text);
+    END IF;
+    RETURN NULL;
+END
+$$ LANGUAGE plpgsql;
+
+DROP TRIGGER IF EXISTS trg_%1_notify ON %1;
+
+CREATE TRIGGER trg_%1_notify
+AFTER INSERT OR UPDATE OR DELETE ON %1
+FOR EACH ROW EXECUTE FUNCTION %1_notify();
+)").arg(tableName(true),                        // %1 = Table name
+        notifyChannel(),                        // %2 = Notification channel
+        key);                                   // %3 = Primary key column
+    return sql.trimmed();
+}
+
+/**
+ * @brief Create Sql statements for row versioning
+ *
+ * A trigger stamps each inserted or updated row with the id of the
+ * changing transaction, and records the key of each deleted row in the
+ * tombstone table with the id of the deleting transaction. Transaction
+ * ids are used rather than a sequence so that a watermark taken from a
+ * snapshot never skips a transaction that commits late. Tombstones are
+ * stamped with the time of the delete so that they can be pruned, see
+ * pruneTombstonesSql().
+ *
+ * @returns Sql statements or an empty string if rows are not versioned
+ */
+QString TableSchema::createVersionSql() const {
+    const int keyIndex = plan().primaryKey;
+    if (!m_rowVersioning || keyIndex < 0)
+        return QString();
+    const ColumnDefinition &key = m_columns.at(keyIndex);
+
+    QString sql = QString(R"(
+ALTER TABLE %1
+    ADD COLUMN IF NOT EXISTS row_version BIGINT NOT NULL DEFAULT 0;
+
+CREATE INDEX IF NOT EXISTS %1_row_version_idx ON %1 (row_version);
+
+CREATE TABLE IF NOT EXISTS %2 (
+    %3 %4 PRIMARY KEY,
+    row_version BIGINT NOT NULL);
+
+ALTER TABLE %2
+    ADD COLUMN IF NOT EXISTS deleted_at TIMESTAMPTZ NOT NULL DEFAULT now();
+
+CREATE INDEX IF NOT EXISTS %2_row_version_idx ON %2 (row_version);
+
+CREATE INDEX IF NOT EXISTS %2_deleted_at_idx ON %2 (deleted_at);
+
+CREATE OR REPLACE FUNCTION %1_version() RETURNS trigger AS $$
+BEGIN
+    IF TG_OP = 'DELETE' THEN
+        INSERT INTO %2 (%3, row_version, deleted_at)
+            VALUES (OLD.%3, pg_current_xact_id()::text::bigint, now())
+            ON CONFLICT (%3) DO UPDATE SET row_version = EXCLUDED.row_version, deleted_at = EXCLUDED.deleted_at;
+        RETURN OLD;
+    END IF;
+    NEW.row_version := pg_current_xact_id()::text::bigint;
+    RETURN NEW;
+END
+$$ LANGUAGE plpgsql;
+
+DROP TRIGGER IF EXISTS trg_%1_version ON %1;
+
+CREATE TRIGGER trg_%1_version
+BEFORE INSERT OR UPDATE OR DELETE ON %1
+FOR EACH ROW EXECUTE FUNCTION %1_version();
+)").arg(tableName(true),                        // %1 = Table name
+        tombstoneTableName(),                   // %2 = Tombstone table name
+        key.name,                               // %3 = Primary key column
+        key.sqlType);                           // %4 = Primary key type
+    return sql.trimmed();
+}
+
+/**
+ * @brief Create Sql statement removing tombstones older than the horizon
+ *
+ * @returns Sql statement or an empty string if rows are not versioned
+ */
+QString TableSchema::pruneTombstonesSql() const {
+    if (!m_rowVersioning || plan().primaryKey < 0)
+        return QString();
+    return QString(R"(
+DELETE FROM %1
+    WHERE deleted_at < now() - make_interval(secs => %2)
+)").arg(tombstoneTableName(),                   // %1 = Tombstone table name
+    QString::number(m_tombstoneHorizon));       // %2 = Seconds tombstones are kept
+}
+
+/**
+ * @brief Create Sql statement for creating an index
+ *
+ * The index is built concurrently so that writers are not blocked, which
+ * means the statement must be executed on its own and not in a transaction.
+ *
+ * @param index Named index definition, see indexes()
+ * @returns QString Sql statement
+ */
+QString TableSchema::createIndexSql(const IndexDefinition &index) const {
+    return QString(R"(
+CREATE %1INDEX CONCURRENTLY IF NOT EXISTS %2
+    ON %3 (%4)%5%6
+)").arg(index.isUnique ? "UNIQUE " : "",        // %1 = Unique index
+    index.name,                                 // %2 = Index name
+    tableName(true),                            // %3 = Table name
+    index.columns.join(", "),                   // %4 = Indexed columns or expressions
+    index.include.isEmpty() ? "" : QString("\n    INCLUDE (%1)").arg(index.include.join(", ")), // %5 = Covered columns
+    index.where.isEmpty() ? "" : QString("\n    WHERE %1").arg(index.where)).trimmed(); // %6 = Partial index predicate
+}
+
+/**
+ * @brief Create Sql statement for emptying the staging table
+ *
+ * Needed when several upserts run within one transaction, as the staging
+ * table is only emptied when the transaction commits.
+ *
+ * @returns QString Sql statement
+ */
+QString TableSchema::clearStagingSql() const {
+    return QString("TRUNCATE %1").arg(stagingTableName());
+}
+
+/**
+ * @brief Create Sql statement for creating the staging table used for bulk upserts
+ *
+ * The staging table is a temporary copy of the table's columns that lives for the
+ * rest of the session. Its rows are discarded whenever a transaction commits.
+ *
+ * @returns QString Sql statement
+ */
+QString TableSchema::createStagingSql() const {
+    return QString(R"(
+CREATE TEMPORARY TABLE
+    IF NOT EXISTS %1 (LIKE %2 INCLUDING DEFAULTS)
+    ON COMMIT DELETE ROWS
+)").arg(stagingTableName(),                     // %1 = Name of staging table
+    tableName(true));                           // %2 = Name of table
+}
+
 /**
  * @brief Create Sql statement for creating table in database
  *
@@ -533,6 +1079,55 @@ VALUES
     placeholders.join(", "));                   // %4 = List of placeholder names
 }
 
+/**
+ * @brief Create Sql statement for inserting several rows into table
+ *
+ * The insert will always include the primary key. All rows must hold the same
+ * columns as the data provided. Placeholders are suffixed with the row number,
+ * e.g. ":ven_name_0", ":ven_name_1".
+ *
+ * @param data Variant map holding the columns to be inserted
+ * @param rowCount Number of rows to be inserted
+ * @param staging True to insert into the staging table instead of the table
+ * @returns QString Sql statement
+ */
+QString TableSchema::insertSql(const QVariantMap &data, int rowCount, bool staging) const {
+    QStringList columns;
+    QStringList placeholders;
+    QStringList rows;
+
+    // Add primary key and any field in the variant map to column and placeholder list
+    for (auto it = m_columns.constBegin(); it != m_columns.constEnd(); ++it) {
+        const QString name = it->name;
+        QString alias = QString("%1_%2").arg(m_alias, name);
+        if (it->isPrimaryKey || data.contains(alias)) {
+            columns << name;
+            placeholders << ":" + alias;
+        }
+    }
+
+    // Add a list of placeholders for each row
+    rows.reserve(rowCount);
+    for (int row = 0; row < rowCount; ++row) {
+        const QString suffix = QString("_%1").arg(row);
+        QStringList values;
+        for (const QString &placeholder : std::as_const(placeholders))
+            values << placeholder + suffix;
+        rows << "(" + values.join(", ") + ")";
+    }
+
+    // Return generated insert
+    return QString(R"(
+INSERT INTO %1 AS %2
+    (%3)
+VALUES
+    %4
+)").arg(staging ? stagingTableName() : tableName(true), // %1 = Name of table
+    m_alias,                                    // %2 = Alias
+    columns.join(", "),                         // %3 = List of column to be added to table
+    rows.join(",\n    "));                      // %4 = List of placeholder names for each row
+}
+
 /**
  * @brief Create Sql statement for selecting a row from table
  *
@@ -567,10 +1162,11 @@ WHERE
  *
  * @param filters Filter structure to be applied to select
  * @param useLabels True to use labeled enumerated columns
+ * @param projection Indexes of columns to be selected in ascending order, all columns when empty
  * @returns QString Sql statement
  */
-QString TableSchema::selectSql(const QList<FilterCondition> &filters, bool useLabels) const {
-    QStringList const columns = columnFields(true, useLabels);
+QString TableSchema::selectSql(const QList<FilterCondition> &filters, bool useLabels, const QList<int> &projection) const {
+    QStringList const columns = projectedFields(useLabels, projection);
 
     // Return generated statement
     return QString(R"(
@@ -588,16 +1184,18 @@ FROM %2 AS %3
  * @brief Create Sql statement for selecting a series of rows from table
  *
  * All columns of a table will be selected, including the primary key.
- * A sort column and order needs to be provided.
+ * A sort column and order needs to be provided. The primary key breaks ties
+ * so that rows are returned in the same order as by the paged select.
  *
  * @param filters Filter structure to be applied to select
  * @param sortColumn Name of column to be used to sort data
  * @param sortOrder Sort direction of returned data
  * @param useLabels True to use labeled enumerated columns
+ * @param projection Indexes of columns to be selected in ascending order, all columns when empty
  * @returns QString Sql statement
  */
-QString TableSchema::selectSql(const QList<FilterCondition> &filters, const QString &sortColumn, const Qt::SortOrder sortOrder, bool useLabels) const {
-    QStringList const columns = columnFields(true, useLabels);
+QString TableSchema::selectSql(const QList<FilterCondition> &filters, const QString &sortColumn, const Qt::SortOrder sortOrder, bool useLabels, const QList<int> &projection) const {
+    QStringList const columns = projectedFields(useLabels, projection);
 
     // Return generated statement
     return QString(R"(
@@ -605,13 +1203,170 @@ SELECT
     %1
 FROM %2 AS %3
 %4
-ORDER BY %5 %6
+ORDER BY %5 %6, %7 %6
 )").arg(columns.join(", "),                     // %1 = Column expressions
     tableName(true),                            // %2 = Table name
     m_alias,                                    // %3 = Alias
     whereClause(filters),                       // %4 = Where clause
-    toField(sortColumn),                        // %5, %6 = Sort column and direction
-    sortOrder == Qt::AscendingOrder ? "ASC" : "DESC");
+    sortExpression(sortColumn),                 // %5, %6 = Sort column and direction
+    sortOrder == Qt::AscendingOrder ? "ASC" : "DESC",
+    toField(primaryKey()));                     // %7 = Tie-breaker
+}
+
+/**
+ * @brief Create Sql statement for selecting one page of rows from table
+ *
+ * All columns of a table will be selected, including the primary key. Rows are
+ * read with a keyset (seek) predicate rather than an OFFSET, so the cost of a
+ * page does not depend on how far into the result set it lies. The primary key
+ * is used as a tie-breaker for rows with identical sort values.
+ *
+ * When the cursor is valid the caller must bind ":after_key" and, unless the
+ * cursor sort value is null, ":after_sort".
+ *
+ * @param filters Filter structure to be applied to select
+ * @param sortColumn Name of column to be used to sort data
+ * @param sortOrder Sort direction of returned data
+ * @param after Position of the last row read or an invalid cursor for the first page
+ * @param pageSize Maximum number of rows to be returned
+ * @param useLabels True to use labeled enumerated columns
+ * @param projection Indexes of columns to be selected in ascending order, all columns when empty
+ * @returns QString Sql statement
+ */
+QString TableSchema::selectSql(const QList<FilterCondition> &filters, const QString &sortColumn, const Qt::SortOrder sortOrder, const KeysetCursor &after, int pageSize, bool useLabels, const QList<int> &projection) const {
+    QStringList const columns = projectedFields(useLabels, projection);
+    const QString sortField = sortExpression(sortColumn);
+    const bool ascending = sortOrder == Qt::AscendingOrder;
+
+    // Return generated statement
+    return QString(R"(
+SELECT
+    %1
+FROM %2 AS %3
+%4
+ORDER BY %5 %6, %7 %8
+LIMIT %9
+)").arg(columns.join(", "),                     // %1 = Column expressions
+    tableName(true),                            // %2 = Table name
+    m_alias,                                    // %3 = Alias
+    whereClause(filters, keysetClause(sortField, sortOrder, after)), // %4 = Where clause
+    sortField,                                  // %5, %6 = Sort column and direction
+    ascending ? "ASC NULLS LAST" : "DESC NULLS FIRST",
+    toField(primaryKey()),                      // %7, %8 = Tie-breaker and direction
+    ascending ? "ASC" : "DESC",
+    QString::number(pageSize));                 // %9 = Page size
+}
+
+/**
+ * @brief Create Sql statement selecting rows and whether each lies past a page
+ *
+ * The selected columns are followed by a boolean column that is true when
+ * the row sorts after the keyset cursor, as decided by the same predicate
+ * and database collation as the paged select, so the row would be read by
+ * a later page. Rows are not limited to those past the cursor.
+ *
+ * When the cursor is valid the caller must bind ":after_key" and, unless the
+ * cursor sort value is null, ":after_sort".
+ *
+ * @param filters Filter structure to be applied to select
+ * @param sortColumn Name of column used to sort the pages
+ * @param sortOrder Sort direction of the pages
+ * @param after Position of the last row read or an invalid cursor when no page is pending
+ * @param useLabels True to use labeled enumerated columns
+ * @param projection Indexes of columns to be selected in ascending order, all columns when empty
+ * @returns QString Sql statement
+ */
+QString TableSchema::selectPastSql(const QList<FilterCondition> &filters, const QString &sortColumn, const Qt::SortOrder sortOrder, const KeysetCursor &after, bool useLabels, const QList<int> &projection) const {
+    QStringList const columns = projectedFields(useLabels, projection);
+    const QString keyset = keysetClause(sortExpression(sortColumn), sortOrder, after);
+
+    // Return generated statement
+    return QString(R"(
+SELECT
+    %1,
+    COALESCE(%2, FALSE) AS past_page
+FROM %3 AS %4
+%5
+)").arg(columns.join(", "),                     // %1 = Column expressions
+    keyset.isEmpty() ? "FALSE" : keyset,        // %2 = Keyset predicate
+    tableName(true),                            // %3 = Table name
+    m_alias,                                    // %4 = Alias
+    whereClause(filters));                      // %5 = Where clause
+}
+
+/**
+ * @brief Create Sql statement reading the keys of rows changed since a watermark
+ *
+ * Both changed rows and deleted rows are returned, so the result may hold
+ * keys of rows that are no longer in the table or no longer match a filter.
+ *
+ * The statement uses the :watermark placeholder, the value returned by
+ * watermarkSql() before the rows were last read.
+ *
+ * @returns QString Sql statement
+ */
+QString TableSchema::changedKeysSql() const {
+    const SchemaPlan &plan = this->plan();
+    const QString key = m_columns.at(plan.primaryKey).name;
+    return QString(R"(
+SELECT %2::text FROM %1 WHERE row_version >= :watermark
+UNION
+SELECT %2::text FROM %3 WHERE row_version >= :watermark
+)").arg(tableName(true),                        // %1 = Table name
+        key,                                    // %2 = Primary key column
+        tombstoneTableName());                  // %3 = Tombstone table name
+}
+
+/**
+ * @brief Create Sql statement reading the current watermark
+ *
+ * The watermark is the oldest transaction still running. Every change made
+ * by an older transaction is visible to reads that follow, so reading the
+ * changes from the watermark onwards cannot miss any.
+ *
+ * @returns QString Sql statement
+ */
+QString TableSchema::watermarkSql() const {
+    return "SELECT pg_snapshot_xmin(pg_current_snapshot())::text::bigint";
+}
+
+/**
+ * @brief Create Sql statement for locating a row within a sorted result set
+ *
+ * The statement returns the zero based position of the row whose primary key
+ * is bound to ":locate_key" by counting the matching rows that sort before it,
+ * using the same ordering as the paged select. The sort value of every matching
+ * row is read on the server, but no rows are returned to the client. No row is
+ * returned if the row does not match the filters.
+ *
+ * @param filters Filter structure to be applied to select
+ * @param sortColumn Name of column to be used to sort data
+ * @param sortOrder Sort direction of returned data
+ * @returns QString Sql statement
+ */
+QString TableSchema::locateSql(const QList<FilterCondition> &filters, const QString &sortColumn, const Qt::SortOrder sortOrder) const {
+    const QString before = sortOrder == Qt::AscendingOrder
+        ? "(target.sort_value IS NULL AND (matching.sort_value IS NOT NULL OR matching.key_value < target.key_value))"
+          " OR (matching.sort_value, matching.key_value) < (target.sort_value, target.key_value)"
+        : "(matching.sort_value IS NULL AND (target.sort_value IS NOT NULL OR matching.key_value > target.key_value))"
+          " OR (matching.sort_value, matching.key_value) > (target.sort_value, target.key_value)";
+
+    // Return generated statement
+    return QString(R"(
+WITH matching AS (
+    SELECT %1 AS sort_value, %2 AS key_value
+    FROM %3 AS %4
+    %5
+)
+SELECT COUNT(*) FILTER (WHERE %6)
+FROM matching, (SELECT sort_value, key_value FROM matching WHERE key_value = :locate_key) AS target
+HAVING COUNT(*) > 0
+)").arg(sortExpression(sortColumn),             // %1 = Sort column expression
+    toField(primaryKey()),                      // %2 = Primary key
+    tableName(true),                            // %3 = Table name
+    m_alias,                                    // %4 = Alias
+    whereClause(filters),                       // %5 = Where clause
+    before);                                    // %6 = Predicate for rows sorted before the located row
 }
 
 /**
@@ -652,12 +1407,14 @@ WHERE %3 = %4
  * @brief Create Sql statement for updating an existing row or inserting the row if it can't be found
  *
  * At a minimum, there must be the primary key for the row to be inserted
- * along with at least one column to be used to locate the row in the database
- * and one additional column to be updated for the generated sql to be correct.
+ * along with at least one column to be used to locate the row in the database.
+ * When there is no other column to update, a matching row is left as it is.
  * Only valid fields will be added to the generated SQL.
  *
- * Note: This method will work even if no unique constraint has been assigned
- *       to the columns used for matching.
+ * When the match columns are a declared unique key the row is upserted with
+ * INSERT ... ON CONFLICT, a single probe of the key's index that stays
+ * correct under concurrent writers. Otherwise a MERGE is used, which works
+ * without a unique key but may insert duplicates under concurrency.
  *
  * @param data Variant map containing fields and values to be updated
  * @param matchColumns List of column to be used in locating the row
@@ -668,6 +1425,7 @@ QString TableSchema::updateInsertSql(const QVariantMap &data, const QStringList
     QStringList sourcePlaceholders;
     QStringList matches;
     QStringList assignments;
+    QStringList excluded;
 
     // Build list of source columns, placeholders and assignments
     for (const ColumnDefinition &column : m_columns) {
@@ -684,28 +1442,184 @@ QString TableSchema::updateInsertSql(const QVariantMap &data, const QStringList
             } else if (!column.isPrimaryKey) {
                 QString assign = QString("%1 = %2").arg(column.name, ":" + alias);
                 assignments << assign;
+                excluded << QString("%1 = EXCLUDED.%1").arg(column.name);
             }
         }
     }
 
+    // Upsert against the unique key
+    if (isUniqueKey(matchColumns)) {
+        QStringList keyColumns;
+        for (const QString &alias : matchColumns)
+            keyColumns << toName(alias);
+        return QString(R"(
+INSERT INTO %1 (%2)
+VALUES (%3)
+ON CONFLICT (%4) %5
+)").arg(tableName(true),                        // %1 = Name of table
+        sourceColumns.join(", "),               // %2 = List of all source columns in the data
+        sourcePlaceholders.join(", "),          // %3 = List of all source placeholders in the data
+        keyColumns.join(", "),                  // %4 = Unique key columns
+        excluded.isEmpty() ? "DO NOTHING" : "DO UPDATE SET " + excluded.join(", ")); // %5 = Columns to be updated, if any
+    }
+
     // Return generated statement
     return QString(R"(
 MERGE INTO %1 AS target
 USING (SELECT %2) AS source
 ON %3
 WHEN MATCHED THEN
-UPDATE SET %4
+%4
 WHEN NOT MATCHED THEN
 INSERT (%5)
 VALUES (%6)
 )").arg(tableName(true),                        // %1 = Name of table
     sourcePlaceholders.join(", "),              // %2 = List of all source placeholders in the data
     matches.join(" AND "),                      // %3 = List of columns to match on
-    assignments.join(", "),                     // %4 = List of columns to be updated
+    assignments.isEmpty() ? "DO NOTHING" : "UPDATE SET " + assignments.join(", "), // %4 = Columns to be updated, if any
     sourceColumns.join(", "),                   // %5 = List of all source columns in the data
     sourcePlaceholders.join(", "));             // %6 = List of all source placeholders in the data
 }
 
+/**
+ * @brief Format list of values as a PostgreSQL array literal
+ *
+ * @param values Values to be placed in array
+ * @returns Array literal e.g. {"a","b"}
+ */
+QString TableSchema::arrayLiteral(const QVariantList &values) const {
+    QStringList elements;
+
+    for (const QVariant &value : values) {
+        if (value.isNull()) {
+            elements << "NULL";
+            continue;
+        }
+        QString element = value.userType() == QMetaType::QDate
+            ? value.toDate().toString(Qt::ISODate)
+            : value.toString();
+        element.replace("\\", "\\\\").replace("\"", "\\\"");
+        elements << "\"" + element + "\"";
+    }
+    return "{" + elements.join(",") + "}";
+}
+
+/**
+ * @brief Create Sql statement that applies all staged rows to the table
+ *
+ * Staged rows that match an existing row on the match columns update it,
+ * all others are inserted. When nothing but the primary key and the match
+ * columns was staged, matching rows are left as they are. Staged rows must be
+ * unique on the match columns. When the match columns are a declared unique
+ * key this is done with INSERT ... ON CONFLICT, otherwise with MERGE.
+ *
+ * The statement returns a single row holding the number of rows inserted
+ * and the number updated, as reported by the statement that applied them.
+ * Counting MERGE actions requires PostgreSQL 17 or later.
+ *
+ * @param data Variant map holding the columns that were staged
+ * @param matchColumns List of column to be used in locating the row
+ * @returns QString Sql statement
+ */
+QString TableSchema::mergeStagingSql(const QVariantMap &data, const QStringList matchColumns) const {
+    QStringList columns;
+    QStringList values;
+    QStringList matches;
+    QStringList assignments;
+    QStringList excluded;
+
+    // Build list of columns, values, matches and assignments
+    for (const ColumnDefinition &column : m_columns) {
+        const QString alias = QString("%1_%2").arg(m_alias, column.name);
+        if (!column.isPrimaryKey && !data.contains(alias))
+            continue;
+        columns << column.name;
+        values << "source." + column.name;
+        if (matchColumns.contains(alias))
+            matches << QString("target.%1 = source.%1").arg(column.name);
+        else if (!column.isPrimaryKey) {
+            assignments << QString("%1 = source.%1").arg(column.name);
+            excluded << QString("%1 = EXCLUDED.%1").arg(column.name);
+        }
+    }
+
+    // Upsert against the unique key
+    if (isUniqueKey(matchColumns)) {
+        QStringList keyColumns;
+        for (const QString &alias : matchColumns)
+            keyColumns << toName(alias);
+        return QString(R"(
+WITH applied AS (
+    INSERT INTO %1 (%2)
+    SELECT %3 FROM %4 AS source
+    ON CONFLICT (%5) %6
+    RETURNING (xmax = 0) AS inserted
+)
+SELECT COUNT(*) FILTER (WHERE inserted), COUNT(*) FILTER (WHERE NOT inserted)
+    FROM applied
+)").arg(tableName(true),                        // %1 = Name of table
+        columns.join(", "),                     // %2 = List of staged columns
+        values.join(", "),                      // %3 = List of staged values
+        stagingTableName(),                     // %4 = Name of staging table
+        keyColumns.join(", "),                  // %5 = Unique key columns
+        excluded.isEmpty() ? "DO NOTHING" : "DO UPDATE SET " + excluded.join(", ")); // %6 = Columns to be updated, if any
+    }
+
+    // Return generated statement
+    return QString(R"(
+WITH applied AS (
+    MERGE INTO %1 AS target
+    USING %2 AS source
+    ON %3
+    WHEN MATCHED THEN
+    %4
+    WHEN NOT MATCHED THEN
+    INSERT (%5)
+    VALUES (%6)
+    RETURNING merge_action() AS action
+)
+SELECT COUNT(*) FILTER (WHERE action = 'INSERT'), COUNT(*) FILTER (WHERE action = 'UPDATE')
+    FROM applied
+)").arg(tableName(true),                        // %1 = Name of table
+    stagingTableName(),                         // %2 = Name of staging table
+    matches.join(" AND "),                      // %3 = List of columns to match on
+    assignments.isEmpty() ? "DO NOTHING" : "UPDATE SET " + assignments.join(", "), // %4 = Columns to be updated, if any
+    columns.join(", "),                         // %5 = List of staged columns
+    values.join(", "));                         // %6 = List of staged values
+}
+
+/**
+ * @brief Create Sql statement counting the key values held by more than one row
+ *
+ * @param columns Names of the key columns
+ * @returns QString Sql statement
+ */
+QString TableSchema::duplicateKeysSql(const QStringList &columns) const {
+    return QString(R"(
+SELECT COUNT(*)
+    FROM (SELECT 1 FROM %1 GROUP BY %2 HAVING COUNT(*) > 1) AS duplicates
+)").arg(tableName(true),                        // %1 = Name of table
+    columns.join(", "));                        // %2 = List of key columns
+}
+
+/**
+ * @brief Get name of the staging table used for bulk upserts
+ *
+ * @returns Name of staging table
+ */
+QString TableSchema::stagingTableName() const {
+    return tableName(true) + "_staging";
+}
+
+/**
+ * @brief Get name of the table holding the keys of deleted rows
+ *
+ * @returns Name of tombstone table
+ */
+QString TableSchema::tombstoneTableName() const {
+    return tableName(true) + "_tombstones";
+}
+
 /**
  * @brief Convert constraint to related SQL syntax
  *
@@ -742,23 +1656,21 @@ std::shared_ptr<EnumConstraint> TableSchema::enumConstraint(const QString &colum
 }
 
 /**
- * @brief Return SQL clause that will convert an enumerated column to a label value
+ * @brief Return SQL expression ranking an enumerated column in label order
  *
  * @param columnName Name of column
- * @param constraint Enumertated constraint. Contains label values
- * @returns SQL Case statement
+ * @param labels Label lookup of the column
+ * @returns SQL Case expression, null for null values
  */
-QString TableSchema::enumClause(const QString &columnName, const EnumConstraint &constraint) const {
-    QString clause = QString("(CASE %1.%2").arg(m_alias, columnName);
+QString TableSchema::rankClause(const QString &columnName, const EnumLabels &labels) const {
+    const QString field = QString("%1.%2").arg(m_alias, columnName);
+    QString clause = QString("(CASE WHEN %1 IS NULL THEN NULL").arg(field);
 
-    QList<int> values = constraint.allowedValues();
-    for (int i = 0; i < values.size(); ++i) {
-        int value = values.at(i);
-        QString label = constraint.labelFor(value);
-        clause += QString(" WHEN %1 THEN %2").arg(QString::number(value), formatValue(label, ColumnType::String));
-        // ...
+    for (int i = 0; i < labels.ranks.size(); ++i) {
+        if (labels.ranks.at(i) >= 0)
+            clause += QString(" WHEN %1 = %2 THEN %3").arg(field, QString::number(labels.minimum + i), QString::number(labels.ranks.at(i)));
     }
-    clause += QString(" ELSE 'Unknown' END)");
+    clause += QString(" ELSE %1 END)").arg(labels.unknownRank);
     return clause;
 }
 
@@ -793,45 +1705,135 @@ bool TableSchema::isEnumConstraint(const ColumnDefinition &col) const {
     return std::dynamic_pointer_cast<EnumConstraint>(col.constraint) != nullptr;
 }
 
+/**
+ * @brief Convert a loaded value to the value compared by the sort expression
+ *
+ * Values of labeled enumerated columns sorted by rank are converted to
+ * their rank, so they can be bound against sortExpression().
+ *
+ * @param alias Alias name of sort column
+ * @param value Value as loaded
+ * @return Value to be bound
+ */
+QVariant TableSchema::sortValue(const QString &alias, const QVariant &value) const {
+    const SchemaPlan &plan = this->plan();
+    const int index = plan.labelOrdinals.value(alias, -1);
+    if (index < 0 || plan.ordinals.contains(alias) || value.isNull())
+        return value;
+    const EnumLabels *labels = plan.enumLabels.at(index).get();
+    return labels && !labels->valueOrdered ? QVariant(labels->rank(value.toLongLong())) : value;
+}
+
+/**
+ * @brief Convert column alias to the expression used for sorting
+ *
+ * Labeled enumerated columns are sorted on the rank of their label, or on
+ * their field when label order is the same as value order so that an index
+ * on the column can be used. All other columns are sorted on their field.
+ *
+ * @param alias Alias name
+ * @return Sort expression
+ */
+QString TableSchema::sortExpression(const QString &alias) const {
+    const SchemaPlan &plan = this->plan();
+    const int index = plan.labelOrdinals.value(alias, -1);
+    if (index >= 0 && !plan.ordinals.contains(alias)) {
+        const EnumLabels *labels = plan.enumLabels.at(index).get();
+        if (labels && !labels->valueOrdered)
+            return rankClause(m_columns.at(index).name, *labels);
+        return QString("%1.%2").arg(m_alias, m_columns.at(index).name);
+    }
+    return toField(alias);
+}
+
+/**
+ * @brief Get select expressions of a subset of columns
+ *
+ * @param useLabels True to use labeled enumerated columns
+ * @param projection Indexes of columns to be selected in ascending order, all columns when empty
+ * @returns QString list of column expressions and their aliases
+ */
+QStringList TableSchema::projectedFields(bool useLabels, const QList<int> &projection) const {
+    const QStringList fields = columnFields(true, useLabels);
+    if (projection.isEmpty())
+        return fields;
+
+    QStringList projected;
+    for (int index : projection)
+        projected << fields.at(index);
+    return projected;
+}
+
 /**
  * @brief Generate where clause to be used in SQL statement
  *
+ * Values are referenced through placeholders, see filterValues() for the values
+ * to be bound.
+ *
  * @param conditions Structure containing where clause to be applied to statement
+ * @param predicate Optional additional predicate that is and'ed with the conditions
  * @return String to be inserted as where clause
  */
-QString TableSchema::whereClause(const QList<FilterCondition> &conditions) const {
+QString TableSchema::whereClause(const QList<FilterCondition> &conditions, const QString &predicate) const {
     QStringList clauses;
 
-    for (const auto &cond : conditions) {
-        auto it = std::find_if(m_columns.begin(), m_columns.end(),
-            [&](const ColumnDefinition &col) { return col.name == toName(cond.columnName); });
+    for (int i = 0; i < conditions.size(); ++i) {
+        const auto &cond = conditions.at(i);
+        const int index = ordinal(cond.columnName);
 
-        if (it == m_columns.end()) {
+        if (index < 0) {
             qWarning() << "Unknown column:" << cond.columnName;
             continue;
         }
 
-        const auto &col = *it;
+        const auto &col = m_columns.at(index);
         const QString opStr = operatorToSql(cond.op);
+        const QString placeholder = QString(":filter_%1").arg(i);
 
         if (cond.op == FilterOperator::IsNull || cond.op == FilterOperator::IsNotNull) {
             clauses << QString("%1 %2").arg(col.name, opStr);
-        } else if (cond.op == FilterOperator::In && cond.value.canConvert<QVariantList>()) {
-            QStringList values;
-            const QList<QVariant> list = cond.value.toList();
-            for (const auto &v : list) {
-                values << formatValue(v, col.type);
-            }
-            clauses << QString("%1 IN (%2)").arg(col.name, values.join(", "));
+        } else if (cond.op == FilterOperator::In) {
+            clauses << QString("%1 = ANY(CAST(%2 AS %3[]))").arg(col.name, placeholder, col.sqlType);
+        } else if (cond.op == FilterOperator::Like && col.type != ColumnType::String) {
+            clauses << QString("CAST(%1 AS TEXT) %2 %3").arg(col.name, opStr, placeholder);
         } else {
-            QString valStr = formatValue(cond.value, col.type);
-            clauses << QString("%1 %2 %3").arg(col.name, opStr, valStr);
+            clauses << QString("%1 %2 %3").arg(col.name, opStr, placeholder);
         }
     }
 
+    if (!predicate.isEmpty())
+        clauses << predicate;
+
     return clauses.isEmpty() ? "" : "WHERE " + clauses.join(" AND ");
 }
 
+/**
+ * @brief Generate keyset predicate that positions a select after a cursor
+ *
+ * Null sort values are ordered last when ascending and first when descending,
+ * which matches the PostgreSQL defaults so that a single index serves both
+ * directions.
+ *
+ * @param sortField Sort column expression
+ * @param sortOrder Sort direction of returned data
+ * @param after Position of the last row read
+ * @return Predicate to be added to the where clause or blank for the first page
+ */
+QString TableSchema::keysetClause(const QString &sortField, const Qt::SortOrder sortOrder, const KeysetCursor &after) const {
+    const QString keyField = toField(primaryKey());
+
+    if (!after.isValid)
+        return "";
+    if (sortOrder == Qt::AscendingOrder) {
+        if (after.sortValue.isNull())
+            return QString("(%1 IS NULL AND %2 > :after_key)").arg(sortField, keyField);
+        return QString("((%1, %2) > (:after_sort, :after_key) OR %1 IS NULL)").arg(sortField, keyField);
+    }
+    if (after.sortValue.isNull())
+        return QString("(%1 IS NOT NULL OR %2 < :after_key)").arg(sortField, keyField);
+    return QString("(%1, %2) < (:after_sort, :after_key)").arg(sortField, keyField);
+}
+
 /**
  * @brief Convert operator to related SQL syntax
  *
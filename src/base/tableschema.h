@@ -2,7 +2,9 @@
 #define TABLESCHEMA_H
 
 #include <QObject>
+#include <QHash>
 #include <QVariantMap>
+#include <memory>
 #include "columnconstraint.h"
 
 enum class FilterOperator {                         // Where filter operators
@@ -40,6 +42,12 @@ struct FilterCondition {                            // Filter condition structur
     QVariant value;                                 // Optional, depending on op
 };
 
+struct KeysetCursor {                               // Keyset (seek) pagination position
+    QVariant sortValue;                             // Sort column value of last row read
+    QVariant key;                                   // Primary key value of last row read
+    bool isValid = false;                           // False when the first page is to be read
+};
+
 struct ColumnDefinition {                           // Column definition structure
     QString name;                                   // Internal name
     QString title;                                  // Display title
@@ -62,6 +70,26 @@ struct ForeignKey {                                 // Foreign key structure
     ReferentialAction onUpdate = ReferentialAction::NoAction;
 };
 
+struct IndexDefinition {                            // Index structure
+    QStringList columns;                            // Column names or expressions e.g. "lower(name)"
+    bool isUnique = false;                          // True for a unique index
+    QString where;                                  // Optional predicate of a partial index e.g. "amount > 0"
+    QStringList include;                            // Optional columns stored in the index but not searched
+    QString name;                                   // Optional name, generated from table and columns when empty
+};
+
+struct SchemaPlan {                                 // Precomputed column lookups, compiled once per schema
+    QStringList aliases;                            // Column aliases
+    QStringList labelAliases;                       // Column aliases with labeled enumerated columns
+    QStringList fields;                             // Qualified column names
+    QStringList placeholders;                       // Column placeholders
+    QStringList titles;                             // Column titles
+    QHash<QString, int> ordinals;                   // Column alias to column ordinal
+    QHash<QString, int> labelOrdinals;              // Labeled column alias to column ordinal
+    QVector<std::shared_ptr<const EnumLabels>> enumLabels; // Label lookup of each enumerated column by ordinal, null for other columns
+    int primaryKey = -1;                            // Ordinal of primary key or -1 if there is none
+};
+
 class TableSchema : public QObject
 {
     Q_OBJECT
@@ -70,8 +98,25 @@ public:
 
     void addColumn(const ColumnDefinition &column);
     void addForeignKey(const ForeignKey &fk);
+    void addIndex(const IndexDefinition &index);
+    void addUniqueKey(const QStringList &columns);
+    void dropIndex(const QString &name);
+    QStringList droppedIndexes() const;
+    bool isUniqueKey(const QStringList &columns) const;
+    void setUniqueKeyBuilt(const QStringList &columns, bool built);
+    void setSortIndexes(bool sortIndexes);
+    QList<IndexDefinition> indexes() const;
     QString tableName(bool forSql=false) const;
     const QList<ColumnDefinition> &columns() const;
+    const SchemaPlan &plan() const;
+    void compilePlan();
+    void setNotifyChanges(bool notify);
+    bool notifyChanges() const;
+    QString notifyChannel() const;
+    void setRowVersioning(bool versioning);
+    bool rowVersioning() const;
+    void setTombstoneHorizon(int seconds);
+    int tombstoneHorizon() const;
 
     QVariantMap initialize();
 
@@ -84,45 +129,82 @@ public:
     QStringList columnTitles(bool includePrimary = true) const;
     QStringList columnTypes(bool includePrimary = true) const;
     QVariantMap columnValues(const QString &alias) const;
+    QVariantMap filterValues(const QList<FilterCondition> &filters) const;
     QString defaultSort() const;
     QString primaryKey(bool placeholder = false) const;
     QString toAlias(const QString placeholder) const;
     QString toField(const QString alias) const;
     QString toName(const QString alias) const;
+    int ordinal(const QString &alias, bool useLabels = false) const;
+    QVariant sortValue(const QString &alias, const QVariant &value) const;
 
     // Validation methods
     bool isAliasListValid(QStringList &nameList, bool useLabels=false) const;
     bool isAliasValid(QString &name, bool useLabels=false) const;
+    QVariantMap validate(const QVariantMap &row) const;
+    QVariantMap validate(const QVariantList &rows) const;
 
     // Generate Sql
+    QString clearStagingSql() const;
     QString countSql() const;
     QString createColumnConstraintSql() const;
     QString createForeignKeySql() const;
+    QString createIndexSql(const IndexDefinition &index) const;
+    QString createNotifySql() const;
+    QString createVersionSql() const;
+    QString createStagingSql() const;
     QString createTableSql() const;
     QString deleteSql() const;
+    QString pruneTombstonesSql() const;
+    QString duplicateKeysSql(const QStringList &columns) const;
     QString insertSql(const QVariantMap &data) const;
+    QString insertSql(const QVariantMap &data, int rowCount, bool staging = false) const;
+    QString mergeStagingSql(const QVariantMap &data, const QStringList matchColumns) const;
     QString selectSql(bool useLabels = false) const;
-    QString selectSql(const QList<FilterCondition> &filters, bool useLabels = false) const;
-    QString selectSql(const QList<FilterCondition> &filters, const QString &sortColumn, const Qt::SortOrder sortOrder, bool useLabels = false) const;
+    QString selectSql(const QList<FilterCondition> &filters, bool useLabels = false, const QList<int> &projection = {}) const;
+    QString selectSql(const QList<FilterCondition> &filters, const QString &sortColumn, const Qt::SortOrder sortOrder, bool useLabels = false, const QList<int> &projection = {}) const;
+    QString selectSql(const QList<FilterCondition> &filters, const QString &sortColumn, const Qt::SortOrder sortOrder, const KeysetCursor &after, int pageSize, bool useLabels = false, const QList<int> &projection = {}) const;
+    QString selectPastSql(const QList<FilterCondition> &filters, const QString &sortColumn, const Qt::SortOrder sortOrder, const KeysetCursor &after, bool useLabels = false, const QList<int> &projection = {}) const;
+    QString changedKeysSql() const;
+    QString watermarkSql() const;
+    QString locateSql(const QList<FilterCondition> &filters, const QString &sortColumn, const Qt::SortOrder sortOrder) const;
     QString updateSql(const QVariantMap &data) const;
     QString updateInsertSql(const QVariantMap &data, const QStringList matchColumns) const;
+    QString stagingTableName() const;
+    QString tombstoneTableName() const;
+
+signals:
+    void schemaChanged();
 
 private:
     // Constraints
     std::shared_ptr<EnumConstraint> enumConstraint(const QString &columnName) const;
 
     // Utlity methods
+    QString arrayLiteral(const QVariantList &values) const;
     QString constraintClause(const QString policy, const ReferentialAction constraint) const;
-    QString enumClause(const QString &columnName, const EnumConstraint &constraint) const;
+    QString rankClause(const QString &columnName, const EnumLabels &labels) const;
     QString formatValue(const QVariant &value, ColumnType type) const;
     bool isEnumConstraint(const ColumnDefinition &col) const;
+    QString keysetClause(const QString &sortField, const Qt::SortOrder sortOrder, const KeysetCursor &after) const;
     QString operatorToSql(FilterOperator op) const;
-    QString whereClause(const QList<FilterCondition> &conditions) const;
+    QString sortExpression(const QString &alias) const;
+    QStringList projectedFields(bool useLabels, const QList<int> &projection) const;
+    QString whereClause(const QList<FilterCondition> &conditions, const QString &predicate = QString()) const;
 
     QString m_tableName;                            // Table name
     QString m_alias;                                // Table alias
     QList<ColumnDefinition> m_columns;              // Column properties
     QList<ForeignKey> m_foreignKeys;                // Foreign keys
+    QList<IndexDefinition> m_indexes;               // Declared indexes
+    QList<QStringList> m_uniqueKeys;                // Column names of each unique key
+    QList<QStringList> m_builtKeys;                 // Column names of each unique key whose index is built
+    QStringList m_droppedIndexes;                   // Names of indexes no longer declared, dropped if they exist
+    bool m_sortIndexes = false;                     // True to index every column that can be sorted on
+    std::shared_ptr<const SchemaPlan> m_plan;       // Compiled column lookups
+    bool m_notifyChanges = false;                   // True to notify listeners of the keys of changed rows
+    bool m_rowVersioning = false;                   // True to record the transaction that last changed each row
+    int m_tombstoneHorizon = 86400;                 // Seconds the keys of deleted rows are kept
 };
 
 #endif // TABLESCHEMA_H
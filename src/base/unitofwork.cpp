@@ -0,0 +1,292 @@
+#include "unitofwork.h"
+#include <QMutex>
+#include <QMutexLocker>
+#include <QHash>
+#include <QRegularExpression>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QDebug>
+#include <utility>
+
+namespace {
+QMutex registryMutex;                               // Guards the registry of units of work
+QHash<QString, UnitOfWork *> registry;              // Units of work by connection name
+}
+
+/**
+ * @brief Unit of work constructor
+ *
+ * @param db Database connection the transaction runs on
+ */
+UnitOfWork::UnitOfWork(const QSqlDatabase &db) : m_db(db) {
+}
+
+/**
+ * @brief Retrieve the unit of work for a connection
+ *
+ * One unit of work exists per connection name, so every table access object
+ * sharing a connection takes part in the same transaction. A unit of work
+ * must only be used from the thread that owns its connection.
+ *
+ * @param db Database connection
+ * @returns Unit of work for the connection
+ */
+UnitOfWork &UnitOfWork::forDatabase(const QSqlDatabase &db) {
+    QMutexLocker locker(&registryMutex);
+    UnitOfWork *&work = registry[db.connectionName()];
+    if (!work)
+        work = new UnitOfWork(db);
+    return *work;
+}
+
+/**
+ * @brief Drop the unit of work of a connection
+ *
+ * This must be called from the thread owning the connection before
+ * the connection is removed. An open transaction is rolled back.
+ *
+ * @param connectionName Name of connection
+ */
+void UnitOfWork::discard(const QString &connectionName) {
+    UnitOfWork *work = nullptr;
+    {
+        QMutexLocker locker(&registryMutex);
+        work = registry.take(connectionName);
+    }
+    if (work && work->isActive())
+        work->m_db.rollback();
+    delete work;
+}
+
+/**
+ * @brief Begin a scope of work
+ *
+ * The outermost scope starts a transaction. Nested scopes start a savepoint,
+ * so that they can be rolled back without abandoning the enclosing work.
+ *
+ * @returns True if successful, otherwise false
+ */
+bool UnitOfWork::begin() {
+    if (m_levels.isEmpty()) {
+        if (!m_db.transaction())
+            return fail("begin failed: " + m_db.lastError().text());
+        m_levels << Level { QString(), 0, true };
+        return true;
+    }
+
+    const QString name = QString("work_%1").arg(m_levels.size());
+    if (!exec("SAVEPOINT " + name))
+        return false;
+    m_levels << Level { name, int(m_deferred.size()), true };
+    return true;
+}
+
+/**
+ * @brief Commit the innermost scope of work
+ *
+ * Savepoints opened within the scope are released with it. Committing the
+ * outermost scope commits the transaction and then sends every deferred
+ * notification in the order they were deferred.
+ *
+ * @returns True if successful, otherwise false
+ */
+bool UnitOfWork::commit() {
+    const int scope = lastScope();
+    if (scope < 0)
+        return fail("commit failed: no transaction in progress");
+
+    const Level level = m_levels.at(scope);
+    m_levels.resize(scope);
+    if (scope > 0)
+        return exec("RELEASE SAVEPOINT " + level.name);
+
+    if (!m_db.commit()) {
+        const QString error = m_db.lastError().text();
+        m_db.rollback();
+        m_deferred.clear();
+        return fail("commit failed: " + error);
+    }
+
+    // Send notifications now that the changes are visible to everyone
+    const QList<Notification> deferred = std::exchange(m_deferred, {});
+    for (const Notification &notification : deferred) {
+        if (notification.context)
+            notification.notify();
+    }
+    return true;
+}
+
+/**
+ * @brief Roll back the innermost scope of work
+ *
+ * Notifications deferred within the scope are discarded.
+ *
+ * @returns True if successful, otherwise false
+ */
+bool UnitOfWork::rollback() {
+    const int scope = lastScope();
+    if (scope < 0)
+        return fail("rollback failed: no transaction in progress");
+
+    const Level level = m_levels.at(scope);
+    m_levels.resize(scope);
+    m_deferred.resize(level.deferred);
+    if (scope > 0)
+        return exec("ROLLBACK TO SAVEPOINT " + level.name) && exec("RELEASE SAVEPOINT " + level.name);
+
+    if (!m_db.rollback())
+        return fail("rollback failed: " + m_db.lastError().text());
+    return true;
+}
+
+/**
+ * @brief Set a named savepoint within the current scope
+ *
+ * @param name Savepoint name, letters, digits and underscores only
+ * @returns True if successful, otherwise false
+ */
+bool UnitOfWork::savepoint(const QString &name) {
+    static const QRegularExpression identifier("^[A-Za-z_][A-Za-z0-9_]*$");
+
+    if (m_levels.isEmpty())
+        return fail("savepoint failed: no transaction in progress");
+    if (!identifier.match(name).hasMatch())
+        return fail("savepoint failed: invalid name " + name);
+    if (!exec("SAVEPOINT " + name))
+        return false;
+    m_levels << Level { name, int(m_deferred.size()), false };
+    return true;
+}
+
+/**
+ * @brief Undo the work done since a named savepoint
+ *
+ * The savepoint remains set, scopes and savepoints opened after it are
+ * closed and their notifications discarded.
+ *
+ * @param name Savepoint name
+ * @returns True if successful, otherwise false
+ */
+bool UnitOfWork::rollbackTo(const QString &name) {
+    const int index = levelOf(name);
+    if (index < 0)
+        return fail("rollback failed: unknown savepoint " + name);
+
+    if (!exec("ROLLBACK TO SAVEPOINT " + name))
+        return false;
+    m_levels.resize(index + 1);
+    m_deferred.resize(m_levels.at(index).deferred);
+    return true;
+}
+
+/**
+ * @brief Release a named savepoint, keeping the work done since it was set
+ *
+ * @param name Savepoint name
+ * @returns True if successful, otherwise false
+ */
+bool UnitOfWork::release(const QString &name) {
+    const int index = levelOf(name);
+    if (index < 0)
+        return fail("release failed: unknown savepoint " + name);
+
+    if (!exec("RELEASE SAVEPOINT " + name))
+        return false;
+    m_levels.resize(index);
+    return true;
+}
+
+/**
+ * @brief Determine if a transaction is in progress
+ *
+ * @returns True if a transaction is in progress, otherwise false
+ */
+bool UnitOfWork::isActive() const {
+    return !m_levels.isEmpty();
+}
+
+/**
+ * @brief Get the number of open scopes and savepoints
+ *
+ * @returns Nesting depth, 0 when no transaction is in progress
+ */
+int UnitOfWork::depth() const {
+    return m_levels.size();
+}
+
+/**
+ * @brief Send a notification once the work is committed
+ *
+ * Without a transaction in progress the notification is sent immediately.
+ *
+ * @param context Object sending the notification, nothing is sent once it is destroyed
+ * @param notify Sends the notification
+ */
+void UnitOfWork::defer(QObject *context, const std::function<void()> &notify) {
+    if (m_levels.isEmpty()) {
+        notify();
+        return;
+    }
+    m_deferred << Notification { context, notify };
+}
+
+/**
+ * @brief Get text of last error generated
+ *
+ * @returns Error text
+ */
+QString UnitOfWork::error() const {
+    return m_error;
+}
+
+/**
+ * @brief Execute a transaction control statement
+ *
+ * @param sql Statement to be executed
+ * @returns True if successful, otherwise false
+ */
+bool UnitOfWork::exec(const QString &sql) {
+    QSqlQuery query(m_db);
+    if (!query.exec(sql))
+        return fail(sql + " failed: " + query.lastError().text());
+    return true;
+}
+
+/**
+ * @brief Find the innermost level holding a named savepoint
+ *
+ * @param name Savepoint name
+ * @returns Index of the level or -1 if not found
+ */
+int UnitOfWork::levelOf(const QString &name) const {
+    for (int i = m_levels.size() - 1; i >= 0; --i) {
+        if (!m_levels.at(i).isScope && m_levels.at(i).name == name)
+            return i;
+    }
+    return -1;
+}
+
+/**
+ * @brief Find the innermost scope
+ *
+ * @returns Index of the level or -1 if no scope is open
+ */
+int UnitOfWork::lastScope() const {
+    for (int i = m_levels.size() - 1; i >= 0; --i) {
+        if (m_levels.at(i).isScope)
+            return i;
+    }
+    return -1;
+}
+
+/**
+ * @brief Failed operation return
+ *
+ * @param error Message indicating error that has occurred
+ * @returns false
+ */
+bool UnitOfWork::fail(const QString &error) {
+    m_error = error;
+    qDebug() << error;
+    return false;
+}
@@ -0,0 +1,54 @@
+#ifndef UNITOFWORK_H
+#define UNITOFWORK_H
+
+#include <QList>
+#include <QObject>
+#include <QPointer>
+#include <QSqlDatabase>
+#include <QString>
+#include <functional>
+
+class UnitOfWork
+{
+public:
+    static UnitOfWork &forDatabase(const QSqlDatabase &db);
+    static void discard(const QString &connectionName);
+
+    bool begin();
+    bool commit();
+    bool rollback();
+    bool savepoint(const QString &name);
+    bool rollbackTo(const QString &name);
+    bool release(const QString &name);
+
+    bool isActive() const;
+    int depth() const;
+    void defer(QObject *context, const std::function<void()> &notify);
+    QString error() const;
+
+private:
+    explicit UnitOfWork(const QSqlDatabase &db);
+
+    struct Level {                                  // Open scope or savepoint
+        QString name;                               // Savepoint name, blank for the transaction itself
+        int deferred = 0;                           // Number of notifications deferred before the level began
+        bool isScope = true;                        // True for a begin() scope, false for a named savepoint
+    };
+
+    struct Notification {                           // Notification held until commit
+        QPointer<QObject> context;                  // Object sending the notification, skipped once destroyed
+        std::function<void()> notify;               // Sends the notification
+    };
+
+    bool exec(const QString &sql);
+    int levelOf(const QString &name) const;
+    int lastScope() const;
+    bool fail(const QString &error);
+
+    QSqlDatabase m_db;                              // Connection the transaction runs on
+    QList<Level> m_levels;                          // Open scopes and savepoints, outermost first
+    QList<Notification> m_deferred;                 // Notifications to be sent once the transaction commits
+    QString m_error;                                // Last error encountered
+};
+
+#endif // UNITOFWORK_H
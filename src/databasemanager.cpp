@@ -1,10 +1,12 @@
 #include "databasemanager.h"
+#include "base/statementcache.h"
 #include "base/tableschema.h"
 #include <QSettings>
 #include <QSqlQuery>
 #include <QSqlError>
 #include <QDebug>
 #include <QCoreApplication>
+#include <utility>
 
 /**
  * @brief Constructor
@@ -13,13 +15,37 @@
  */
 DatabaseManager::DatabaseManager(QObject *parent) : QObject(parent) {
     setObjectName("DatabaseManager");
+    m_notifyTimer.setSingleShot(true);
+    m_notifyTimer.setInterval(200);
+    connect(&m_notifyTimer, &QTimer::timeout, this, &DatabaseManager::deliverNotifications);
+    m_pruneTimer.setInterval(3600000);
+    connect(&m_pruneTimer, &QTimer::timeout, this, &DatabaseManager::pruneTombstones);
+}
+
+/**
+ * @brief Destructor
+ *
+ * Prepared statements of the main connection are released while it is
+ * still open. Pooled connections release theirs on their own threads. The
+ * connection pool is closed once its last lease is returned.
+ */
+DatabaseManager::~DatabaseManager() {
+    StatementCache::forDatabase(m_db).invalidate();
+    if (m_pool) {
+        ConnectionPool::remove(m_db.connectionName());
+        m_pool.reset();
+    }
 }
 
 /**
  * @brief Connect to database
  *
  * Retrieve database connection properties from "config.ini". Establish
- * a connection and return true if successful.
+ * a connection and return true if successful. The connection is then used
+ * as the source of a pool of connections for other threads, sized by the
+ * optional poolKeepOpen, poolMax and poolIdleTimeout (milliseconds) settings.
+ * Connections are opened on first use by each thread, poolKeepOpen only
+ * limits how many idle connections are closed.
  *
  * @return True if successful, otherwise false
  */
@@ -35,6 +61,9 @@ bool DatabaseManager::connect() {
     QString dbname   = settings.value("dbname").toString();
     QString username = settings.value("username").toString();
     QString password = settings.value("password").toString();
+    int     poolKeep = settings.value("poolKeepOpen", settings.value("poolMin", 1)).toInt();
+    int     poolMax  = settings.value("poolMax", 4).toInt();
+    int     poolIdle = settings.value("poolIdleTimeout", 60000).toInt();
 
     settings.endGroup();
 
@@ -52,6 +81,9 @@ bool DatabaseManager::connect() {
     if (!m_db.open())
         return fail("Connection failed: " + m_db.lastError().text());
 
+    // Pool connections for other threads
+    m_pool = ConnectionPool::create(m_db, poolKeep, poolMax, poolIdle);
+
     return success("Connection successful");
 }
 
@@ -62,6 +94,10 @@ bool DatabaseManager::connect() {
  * 1. Add pgcrypto extension to database. This provides a suite of cryptographic
  *    functions that enhance the security of data stored in the database.
  * 2. Initialize all the database tables
+ * 3. Create the indexes of each table, then drop indexes no longer declared
+ *    once every declared index of the table is built
+ * 4. Install row versioning and change notification triggers, prune old
+ *    tombstones, and subscribe to the change notification channels
  *
  * @return True if successful, otherwise false
  */
@@ -100,11 +136,192 @@ bool DatabaseManager::initializeSchema(DatabaseTables *schemas) {
         if (!sql.isEmpty() && !query.exec(sql))
             return fail(tableName + " foreign key failed: " + query.lastError().text());
     }
+    // Initialize indexes, keeping indexes no longer declared until every declared index is built
+    for (TableSchema *table : tables) {
+        qInfo() << "Indexes" << table->tableName();
+        bool complete = true;
+        for (const IndexDefinition &index : table->indexes()) {
+            bool built = false;
+            if (!createIndex(table, index, built))
+                return false;
+            complete = complete && built;
+        }
+        for (const QString &name : complete ? table->droppedIndexes() : QStringList()) {
+            QSqlQuery query;
+            if (!query.exec(QString("DROP INDEX CONCURRENTLY IF EXISTS %1").arg(name)))
+                return fail(table->tableName() + " index drop failed: " + query.lastError().text());
+        }
+    }
+    // Initialize row versioning
+    for (const TableSchema *table : tables) {
+        QSqlQuery query;
+        const QString tableName(table->tableName());
+        const QString sql(table->createVersionSql());
+        qInfo() << "Row versioning" << tableName;
+        if (!sql.isEmpty() && !query.exec(sql))
+            return fail(tableName + " row versioning failed: " + query.lastError().text());
+        if (!sql.isEmpty() && !m_versioned.contains(table))
+            m_versioned << table;
+    }
+    if (!pruneTombstones())
+        return false;
+    m_pruneTimer.start();
+    // Initialize change notification triggers
+    for (const TableSchema *table : tables) {
+        QSqlQuery query;
+        const QString tableName(table->tableName());
+        const QString sql(table->createNotifySql());
+        qInfo() << "Change notification" << tableName;
+        if (!sql.isEmpty() && !query.exec(sql))
+            return fail(tableName + " change notification failed: " + query.lastError().text());
+    }
+    if (!subscribe(tables))
+        return false;
+
+    // Statements prepared before the schema changed may no longer be valid
+    StatementCache::invalidateAll();
 
     // Finish up
     return success("Database schema initialized.");
 }
 
+/**
+ * @brief Create an index if it does not exist
+ *
+ * An index left invalid by an interrupted concurrent build would satisfy
+ * IF NOT EXISTS without ever being used, so it is dropped and rebuilt.
+ * A unique index is not built while rows duplicate its columns. The
+ * duplicates are reported through operationFailed and startup carries on
+ * without the index, so upserts on the key keep using MERGE until the
+ * duplicates are removed by hand. Rows are never removed here.
+ *
+ * @param table Table schema the index belongs to
+ * @param index Named index definition
+ * @param built Returns true if the index exists and is valid
+ * @return True unless a statement failed, otherwise false
+ */
+bool DatabaseManager::createIndex(TableSchema *table, const IndexDefinition &index, bool &built) {
+    QSqlQuery query;
+
+    built = false;
+    table->setUniqueKeyBuilt(index.columns, false);
+
+    // Drop index left by a failed build
+    query.prepare("SELECT indisvalid FROM pg_index WHERE indexrelid = to_regclass(:name)");
+    query.bindValue(":name", index.name);
+    if (!query.exec())
+        return fail(table->tableName() + " index check failed: " + query.lastError().text());
+    const bool exists = query.next();
+    const bool valid = exists && query.value(0).toBool();
+    if (exists && !valid) {
+        qInfo() << "Rebuilding invalid index" << index.name;
+        if (!query.exec(QString("DROP INDEX CONCURRENTLY IF EXISTS %1").arg(index.name)))
+            return fail(table->tableName() + " index drop failed: " + query.lastError().text());
+    }
+
+    // Report rows that stop a unique index from being built, leaving the index unbuilt
+    if (!valid && index.isUnique) {
+        if (!query.exec(table->duplicateKeysSql(index.columns)) || !query.next())
+            return fail(table->tableName() + " duplicate check failed: " + query.lastError().text());
+        const int duplicates = query.value(0).toInt();
+        if (duplicates > 0) {
+            const QString error = QString("%1 unique key %2 cannot be built: %3 values of (%4) are held by more than one row, remove the duplicates and restart")
+                                      .arg(table->tableName(), index.name).arg(duplicates).arg(index.columns.join(", "));
+            qWarning() << error;
+            emit operationFailed(error);
+            return true;
+        }
+    }
+
+    const QString sql(table->createIndexSql(index));
+    if (!query.exec(sql))
+        return fail(table->tableName() + " index " + index.name + " failed: " + query.lastError().text());
+    built = true;
+    if (index.isUnique)
+        table->setUniqueKeyBuilt(index.columns, true);
+    return true;
+}
+
+/**
+ * @brief Subscribe to the change notifications of tables
+ *
+ * Notifications are received on the main connection, so they are
+ * delivered on the thread that connected.
+ *
+ * @param tables Table schemas, only those notifying changes are subscribed
+ * @return True if successful, otherwise false
+ */
+bool DatabaseManager::subscribe(const QVector<TableSchema *> &tables) {
+    QSqlDriver *driver = m_db.driver();
+
+    for (const TableSchema *table : tables) {
+        const QString channel = table->notifyChannel();
+        if (!table->notifyChanges() || m_channels.contains(channel))
+            continue;
+        if (!driver->hasFeature(QSqlDriver::EventNotifications))
+            return fail("Change notification is not supported by the database driver");
+        if (!driver->subscribeToNotification(channel))
+            return fail(table->tableName() + " subscribe failed: " + driver->lastError().text());
+        m_channels.insert(channel, table->tableName());
+    }
+    connect(driver, &QSqlDriver::notification, this, &DatabaseManager::notified, Qt::UniqueConnection);
+    return true;
+}
+
+/**
+ * @brief Collect the key of a changed row
+ *
+ * Keys are held until the notification window closes, so that a burst of
+ * changes such as a bulk import is delivered once. Notifications caused by
+ * this connection or a pooled connection of this process are ignored, since
+ * the objects that made those changes report them, or already hold them
+ * as the state cache does.
+ *
+ * @param channel Channel the notification was sent on
+ * @param source Whether the change was made through this connection
+ * @param payload Server process id of the changing session and primary key of the changed row, as "pid:key"
+ */
+void DatabaseManager::notified(const QString &channel, QSqlDriver::NotificationSource source, const QVariant &payload) {
+    const QString tableName = m_channels.value(channel);
+    if (tableName.isEmpty() || source == QSqlDriver::SelfSource)
+        return;
+
+    const QString text = payload.toString();
+    const int separator = text.indexOf(':');
+    if (separator < 0)
+        return;
+    if (m_pool && m_pool->ownsBackend(QStringView(text).left(separator).toInt()))
+        return;
+    m_notified[tableName].insert(text.mid(separator + 1));
+    if (!m_notifyTimer.isActive())
+        m_notifyTimer.start();
+}
+
+/**
+ * @brief Deliver the keys of rows changed during the notification window
+ */
+void DatabaseManager::deliverNotifications() {
+    const QHash<QString, QSet<QString>> notified = std::exchange(m_notified, {});
+    for (auto it = notified.constBegin(); it != notified.constEnd(); ++it)
+        emit rowsNotified(it.key(), it.value().values());
+}
+
+/**
+ * @brief Remove the keys of rows deleted longer ago than each table's horizon
+ *
+ * @return True if successful, otherwise false
+ */
+bool DatabaseManager::pruneTombstones() {
+    for (const TableSchema *table : std::as_const(m_versioned)) {
+        QSqlQuery query(m_db);
+        if (!query.exec(table->pruneTombstonesSql()))
+            return fail(table->tableName() + " tombstone pruning failed: " + query.lastError().text());
+        if (query.numRowsAffected() > 0)
+            qInfo() << "Pruned" << query.numRowsAffected() << "tombstones of" << table->tableName();
+    }
+    return true;
+}
+
 /**
  * @brief Get the internal QSqlDatabase object stored in the private member m_db.
  *
@@ -114,6 +331,29 @@ QSqlDatabase DatabaseManager::database() const {
     return m_db;
 }
 
+/**
+ * @brief Lease a connection for the current thread
+ *
+ * On the thread that connected this is the main connection, on any other
+ * thread a pooled connection opened by that thread. The connection is
+ * returned when the lease is destroyed.
+ *
+ * @param timeout Milliseconds to wait when every pooled connection is in use
+ * @return Connection lease, invalid if not connected or no connection became free
+ */
+ConnectionLease DatabaseManager::lease(int timeout) const {
+    return m_pool ? m_pool->acquire(timeout) : ConnectionLease();
+}
+
+/**
+ * @brief Get connection pool statistics
+ *
+ * @return Map of pool statistics, empty if not connected
+ */
+QVariantMap DatabaseManager::poolStatistics() const {
+    return m_pool ? m_pool->statistics() : QVariantMap();
+}
+
 /**
  * @brief Get text of last error generated
  *
@@ -1,29 +1,50 @@
 #ifndef DATABASEMANAGER_H
 #define DATABASEMANAGER_H
 
+#include <QHash>
 #include <QObject>
+#include <QSet>
 #include <QSqlDatabase>
+#include <QSqlDriver>
+#include <QTimer>
+#include <memory>
+#include "base/connectionpool.h"
 #include "databasetables.h"
 
 class DatabaseManager : public QObject {
     Q_OBJECT
     QSqlDatabase m_db;                              // Database object
     QString m_error;                                // Last error encountered
+    std::shared_ptr<ConnectionPool> m_pool;         // Pool of per-thread connections cloned from m_db
+    QHash<QString, QString> m_channels;             // Table name of each subscribed notification channel
+    QHash<QString, QSet<QString>> m_notified;       // Keys of changed rows by table name, not yet delivered
+    QTimer m_notifyTimer;                           // Coalesces bursts of notifications into one delivery
+    QVector<const TableSchema *> m_versioned;       // Tables whose rows are versioned
+    QTimer m_pruneTimer;                            // Prunes the tombstones of versioned tables
 
 public:
     explicit DatabaseManager(QObject *parent = nullptr);
+    ~DatabaseManager() override;
 
     bool connect();
     bool initializeSchema(DatabaseTables *schemas);
 
     QSqlDatabase database() const;
+    ConnectionLease lease(int timeout = 5000) const;
+    QVariantMap poolStatistics() const;
     QString error() const;
 
 signals:
+    void rowsNotified(const QString &tableName, const QStringList &ids);
     void operationSuccess(const QString &message);
     void operationFailed(const QString &error);
 
 private:
+    bool createIndex(TableSchema *table, const IndexDefinition &index, bool &built);
+    bool subscribe(const QVector<TableSchema *> &tables);
+    void notified(const QString &channel, QSqlDriver::NotificationSource source, const QVariant &payload);
+    void deliverNotifications();
+    bool pruneTombstones();
     bool fail(QString error);
     bool success(QString message);
 };
@@ -18,6 +18,10 @@ DatabaseTables::DatabaseTables(QObject *parent) : QObject{parent} {
     m_tables.insert(vendor->tableName(), vendor);
     StateTable *state = new StateTable(this);
     m_tables.insert(state->tableName(), state);
+
+    // Freeze column lookups now that all schemas are defined
+    for (TableSchema *table : std::as_const(m_tables))
+        table->compilePlan();
 }
 
 /**
@@ -1,5 +1,6 @@
 #include "databasemanager.h"
 #include "databasetables.h"
+#include "statecache.h"
 #include "tableaccess.h"
 #include "tablemodel.h"
 
@@ -36,6 +37,20 @@ int main(int argc, char *argv[])
     TableModel *categoryModel = new TableModel(dbManager.database(), &tables, "Categories", &app);
     TableAccess *vendorAccess = new TableAccess(dbManager.database(), &tables, "Vendors", &app);
     TableModel *vendorModel = new TableModel(dbManager.database(), &tables, "Vendors", &app);
+    categoryModel->setPageSize(500);
+    vendorModel->setPageSize(500);
+    categoryModel->setAsync(true);
+    vendorModel->setAsync(true);
+    vendorModel->setWindowed(true);
+    categoryModel->setDiffRefresh(true);
+    vendorModel->setDiffRefresh(true);
+    categoryModel->watch(categoryAccess);
+    vendorModel->watch(vendorAccess);
+    categoryModel->watch(&dbManager);
+    vendorModel->watch(&dbManager);
+    categoryAccess->watch(&dbManager);
+    vendorAccess->watch(&dbManager);
+    StateCache::forDatabase(dbManager.database(), &tables)->watch(&dbManager);
     engine.rootContext()->setContextProperty("vendorAccess", vendorAccess);
     engine.rootContext()->setContextProperty("vendorModel", vendorModel);
     engine.rootContext()->setContextProperty("categoryAccess", categoryAccess);
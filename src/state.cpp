@@ -1,13 +1,12 @@
 #include "state.h"
-#include <QSqlQuery>
-#include <QSqlError>
-#include <QRandomGenerator>
-#include <QUuid>
+#include <QJsonArray>
+#include <QJsonDocument>
 
 /**
  * @brief State save and restore constructor
  *
- * Note: All property updates are silent
+ * Note: All property updates are silent. Properties are read from and
+ * saved to the process-wide state cache.
  *
  * @param db Database object where tables are located
  * @param table Table schema to be used for all access
@@ -18,6 +17,7 @@ State::State(QSqlDatabase db, DatabaseTables *tables, QString object, QObject *p
     setObjectName(object + "State");
     m_object = object;
     m_quiet = true;
+    m_cache = StateCache::forDatabase(db, tables);
 }
 
 /**
@@ -59,6 +59,21 @@ QStringList State::restoreStringList(const QString propertyName, const QStringLi
     return propertyValue.split(',');
 }
 
+/**
+ * @brief Restore variant list property
+ *
+ * @param propertyName Name of property to be restored
+ * @param defaultValue Default value for property if not yet set
+ * @returns Property value or default value
+ */
+QVariantList State::restoreVariantList(const QString propertyName, const QVariantList defaultValue) {
+    const QString propertyValue = restoreValue(propertyName);
+    if (propertyValue.isEmpty()) return defaultValue;
+    const QJsonDocument document = QJsonDocument::fromJson(propertyValue.toUtf8());
+    if (!document.isArray()) return defaultValue;
+    return document.array().toVariantList();
+}
+
 /**
  * @brief Save sort order property
  *
@@ -93,62 +108,39 @@ bool State::save(const QString propertyName, const QStringList propertyValue) {
 }
 
 /**
- * @brief Retrieve property value from database
+ * @brief Save variant list property
+ *
+ * The list is saved as a JSON array.
+ *
+ * @param propertyName Name of property to be saved
+ * @param propertyValue Value of property to be saved
+ * @returns True if successful, otherwise false
+ */
+bool State::save(const QString propertyName, const QVariantList propertyValue) {
+    return saveValue(propertyName, QString::fromUtf8(QJsonDocument(QJsonArray::fromVariantList(propertyValue)).toJson(QJsonDocument::Compact)));
+}
+
+/**
+ * @brief Retrieve property value from the state cache
  *
  * @param propertyName Name of property
  * @returns Property value or empty string
  */
 QString State::restoreValue(const QString propertyName) {
-    QSqlQuery query(m_db);
-
-    // Variables needed for getting value from database
-    const QString sql = m_table->selectSql({
-        { "sta_object",         FilterOperator::Equals, m_object},
-        { "sta_property_name",  FilterOperator::Equals, propertyName}
-    });
-
-    // Retrieve record from database
-    query.prepare(sql);
-    if (!query.exec()) {
-        fail("restore failed: " + query.lastError().text());
-        return "";
-    } else if (!query.next()) {
-        return "";
-    }
-    return query.value("sta_property_value").toString();
+    return m_cache->value(m_object, propertyName);
 }
 
 /**
- * @brief Save property property value
+ * @brief Save property value
+ *
+ * The value is held by the state cache and written behind, so the caller
+ * never waits on the database.
  *
  * @param propertyName Name of property to be saved
  * @param propertyValue Value of property to be saved
  * @returns True if successful, otherwise false
  */
 bool State::saveValue(const QString propertyName, const QString propertyValue) {
-    QSqlQuery query(m_db);
-    QVariantMap data;
-    const QStringList matchOn = { "sta_object", "sta_property_name" };
-    const QStringList placeholders = m_table->columnPlaceholders(true);
-
-    // Prepare values to be updated / inserted
-    data["sta_id"]              = QUuid::createUuid();
-    data["sta_object"]          = m_object;
-    data["sta_property_name"]   = propertyName;
-    data["sta_property_value"]  = propertyValue;
-
-    // Prepare query to do update / insert
-    const QString sql = m_table->updateInsertSql(data, matchOn);
-    query.prepare(sql);
-    for (const QString& placeholder : placeholders) {
-        const QString column = m_table->toAlias(placeholder);
-        if (data.contains(column))
-            query.bindValue(placeholder, data[column]);
-    }
-
-    // Update / insert record in database
-    if (!query.exec())
-        return fail("state update failed: " + query.lastError().text());
-
+    m_cache->setValue(m_object, propertyName, propertyValue);
     return success("updated:", propertyName);
 }
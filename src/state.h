@@ -4,6 +4,7 @@
 #include <QObject>
 #include <QSqlDatabase>
 #include "databasetables.h"
+#include "statecache.h"
 #include "tableaccess.h"
 
 class State : public TableAccess
@@ -15,16 +16,19 @@ public:
     Qt::SortOrder restoreSortOrder(const QString propertyName, const Qt::SortOrder defaultValue);
     QString restoreString(const QString propertyName, const QString defaultValue);
     QStringList restoreStringList(const QString propertyName, const QStringList defaultValue);
+    QVariantList restoreVariantList(const QString propertyName, const QVariantList defaultValue);
 
     bool save(const QString propertyName, const Qt::SortOrder propertyValue);
     bool save(const QString propertyName, const QString propertyValue);
     bool save(const QString propertyName, const QStringList propertyValue);
+    bool save(const QString propertyName, const QVariantList propertyValue);
 
 private:
     QString restoreValue(const QString propertyName);
     bool saveValue(const QString propertyName, const QString propertyValue);
 
     QString m_object;                               // Name of object whose properties are being saved
+    StateCache *m_cache;                            // Process-wide cache of saved properties
 };
 
 #endif // STATE_H
@@ -0,0 +1,333 @@
+#include "statecache.h"
+#include "base/connectionpool.h"
+#include "base/statementcache.h"
+#include "databasemanager.h"
+#include <QCoreApplication>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QUuid>
+#include <utility>
+#include <QDebug>
+
+namespace {
+QMutex registryMutex;                               // Guards the registry of caches
+QHash<QString, StateCache *> registry;              // State caches by connection name
+}
+
+/**
+ * @brief State cache constructor
+ *
+ * Every saved property is loaded in a single query. Saves are held in memory
+ * and written behind on a worker thread once the flush delay has passed
+ * without further saves. Anything still pending is written when the
+ * application is about to quit.
+ *
+ * @param db Database object where the States table is located
+ * @param table States table
+ * @param parent Reference to parent class.
+ */
+StateCache::StateCache(QSqlDatabase db, TableSchema *table, QObject *parent) : QObject(parent), m_db(db), m_table(table) {
+    setObjectName("StateCache");
+    preload();
+
+    m_flushTimer.setSingleShot(true);
+    m_flushTimer.setInterval(250);
+    connect(&m_flushTimer, &QTimer::timeout, this, &StateCache::flushBehind);
+    if (QCoreApplication::instance())
+        connect(QCoreApplication::instance(), &QCoreApplication::aboutToQuit, this, &StateCache::shutdown);
+
+    m_worker = new QObject;
+    m_worker->moveToThread(&m_thread);
+    connect(&m_thread, &QThread::finished, m_worker, &QObject::deleteLater);
+    m_thread.start();
+}
+
+/**
+ * @brief Destructor
+ *
+ * Pending values are written before the worker thread is stopped.
+ */
+StateCache::~StateCache() {
+    shutdown();
+    QMutexLocker locker(&registryMutex);
+    registry.remove(m_db.connectionName());
+}
+
+/**
+ * @brief Retrieve the state cache for a connection
+ *
+ * One cache exists per connection name, created and preloaded on first use.
+ * The cache belongs to the application object so that it outlives the
+ * objects whose state it holds.
+ *
+ * @param db Database object where the States table is located
+ * @param tables Database tables
+ * @returns State cache for the connection
+ */
+StateCache *StateCache::forDatabase(QSqlDatabase db, DatabaseTables *tables) {
+    QMutexLocker locker(&registryMutex);
+    StateCache *&cache = registry[db.connectionName()];
+    if (!cache)
+        cache = new StateCache(db, tables->fetch("States"), QCoreApplication::instance());
+    return cache;
+}
+
+/**
+ * @brief Determine if a property has a value
+ *
+ * @param object Name of object owning the property
+ * @param propertyName Name of property
+ * @returns True if the property has been saved, otherwise false
+ */
+bool StateCache::contains(const QString &object, const QString &propertyName) const {
+    return m_values.contains({ object, propertyName });
+}
+
+/**
+ * @brief Get property value
+ *
+ * @param object Name of object owning the property
+ * @param propertyName Name of property
+ * @returns Property value or empty string
+ */
+QString StateCache::value(const QString &object, const QString &propertyName) const {
+    return m_values.value({ object, propertyName });
+}
+
+/**
+ * @brief Set property value
+ *
+ * The value is available immediately and written once the flush delay passes.
+ * Repeated saves of a property before then are written once.
+ *
+ * @param object Name of object owning the property
+ * @param propertyName Name of property
+ * @param propertyValue Value of property
+ */
+void StateCache::setValue(const QString &object, const QString &propertyName, const QString &propertyValue) {
+    const Key key(object, propertyName);
+    auto it = m_values.constFind(key);
+    if (it != m_values.constEnd() && it.value() == propertyValue && !m_pending.contains(key))
+        return;
+    m_values.insert(key, propertyValue);
+    m_pending.insert(key, propertyValue);
+    m_flushTimer.start();
+}
+
+/**
+ * @brief Get number of values waiting to be written
+ *
+ * @returns Number of pending values
+ */
+int StateCache::pending() const {
+    return m_pending.size();
+}
+
+/**
+ * @brief Get delay before pending values are written
+ *
+ * @returns Delay in milliseconds
+ */
+int StateCache::flushDelay() const {
+    return m_flushTimer.interval();
+}
+
+/**
+ * @brief Set delay before pending values are written
+ *
+ * @param flushDelay Delay in milliseconds
+ */
+void StateCache::setFlushDelay(int flushDelay) {
+    m_flushTimer.setInterval(qMax(0, flushDelay));
+}
+
+/**
+ * @brief Write pending values now on the calling thread's connection
+ *
+ * @returns True if successful, otherwise false
+ */
+bool StateCache::flush() {
+    QString error;
+    m_flushTimer.stop();
+    if (m_pending.isEmpty())
+        return true;
+    if (!write(m_db, m_table, m_pending, error)) {
+        qDebug() << "state flush failed:" << error;
+        return false;
+    }
+    m_pending.clear();
+    return true;
+}
+
+/**
+ * @brief Load every saved property
+ *
+ * @returns True if successful, otherwise false
+ */
+bool StateCache::preload() {
+    QSqlQuery query(m_db);
+
+    query.setForwardOnly(true);
+    if (!query.exec(m_table->selectSql(QList<FilterCondition>()))) {
+        qDebug() << "state preload failed:" << query.lastError().text();
+        return false;
+    }
+    while (query.next())
+        store(query);
+    qInfo() << "States preloaded" << m_values.size();
+    return true;
+}
+
+/**
+ * @brief Keep the cache in step with properties saved by other sessions
+ *
+ * @param manager Database manager delivering change notifications
+ */
+void StateCache::watch(DatabaseManager *manager) {
+    connect(manager, &DatabaseManager::rowsNotified, this, [this](const QString &tableName, const QStringList &ids) {
+        if (tableName == m_table->tableName())
+            reload(ids);
+    });
+}
+
+/**
+ * @brief Read changed properties again
+ *
+ * Properties removed from the table are dropped. Properties saved here
+ * but not yet written keep the value saved here.
+ *
+ * @param ids Ids of changed rows
+ * @returns True if successful, otherwise false
+ */
+bool StateCache::reload(const QStringList &ids) {
+    const QList<FilterCondition> filters = { { "sta_id", FilterOperator::In, ids } };
+    const QVariantMap values = m_table->filterValues(filters);
+    QSqlQuery query(m_db);
+
+    // Forget the rows, those still present are stored again
+    for (const QString &id : ids) {
+        const auto it = m_keys.constFind(id);
+        if (it == m_keys.constEnd())
+            continue;
+        if (!m_pending.contains(it.value()))
+            m_values.remove(it.value());
+        m_keys.erase(it);
+    }
+
+    query.setForwardOnly(true);
+    query.prepare(m_table->selectSql(filters));
+    for (auto it = values.constBegin(); it != values.constEnd(); ++it)
+        query.bindValue(it.key(), it.value());
+    if (!query.exec()) {
+        qDebug() << "state reload failed:" << query.lastError().text();
+        return false;
+    }
+    while (query.next())
+        store(query);
+    return true;
+}
+
+/**
+ * @brief Hold the property read by a query
+ *
+ * @param query Query positioned on a States row, selecting every column
+ */
+void StateCache::store(const QSqlQuery &query) {
+    const Key key(query.value(m_table->ordinal("sta_object")).toString(), query.value(m_table->ordinal("sta_property_name")).toString());
+    m_keys.insert(query.value(m_table->ordinal("sta_id")).toString(), key);
+    if (!m_pending.contains(key))
+        m_values.insert(key, query.value(m_table->ordinal("sta_property_value")).toString());
+}
+
+/**
+ * @brief Hand pending values to the worker thread
+ *
+ * Without a connection pool the values are written on this thread instead.
+ */
+void StateCache::flushBehind() {
+    std::shared_ptr<ConnectionPool> pool = ConnectionPool::forConnection(m_db.connectionName());
+    if (!pool || !m_thread.isRunning()) {
+        flush();
+        return;
+    }
+
+    const QHash<Key, QString> values = std::exchange(m_pending, {});
+    const TableSchema *table = m_table;
+    QMetaObject::invokeMethod(m_worker, [pool, table, values]() {
+        QString error;
+        ConnectionLease lease = pool->acquire();
+        if (!lease.isValid())
+            qDebug() << "state write behind failed: connection unavailable";
+        else if (!write(lease.database(), table, values, error))
+            qDebug() << "state write behind failed:" << error;
+    }, Qt::QueuedConnection);
+}
+
+/**
+ * @brief Write pending values and stop the worker thread
+ *
+ * Writes already handed to the worker thread finish first.
+ */
+void StateCache::shutdown() {
+    if (!m_thread.isRunning()) {
+        flush();
+        return;
+    }
+    const QString sourceName = m_db.connectionName();
+    QMetaObject::invokeMethod(m_worker, [sourceName]() {
+        if (std::shared_ptr<ConnectionPool> pool = ConnectionPool::forConnection(sourceName))
+            pool->releaseThread();
+    }, Qt::QueuedConnection);
+    m_thread.quit();
+    m_thread.wait();
+    flush();
+}
+
+/**
+ * @brief Write property values in one transaction
+ *
+ * @param db Connection owned by the calling thread
+ * @param table States table
+ * @param values Property values by object and property name
+ * @param error Returns error text on failure
+ * @returns True if successful, otherwise false
+ */
+bool StateCache::write(QSqlDatabase db, const TableSchema *table, const QHash<Key, QString> &values, QString &error) {
+    const QStringList matchOn = { "sta_object", "sta_property_name" };
+    const SchemaPlan &plan = table->plan();
+    StatementCache &statements = StatementCache::forDatabase(db);
+    QVariantMap data;
+
+    if (!db.transaction()) {
+        error = db.lastError().text();
+        return false;
+    }
+    for (auto it = values.constBegin(); it != values.constEnd(); ++it) {
+        // Prepare values to be updated / inserted
+        data["sta_id"]              = QUuid::createUuid();
+        data["sta_object"]          = it.key().first;
+        data["sta_property_name"]   = it.key().second;
+        data["sta_property_value"]  = it.value();
+
+        // Update / insert record using the statement shared by all properties
+        auto query = statements.prepare(table->tableName() + "/upsert/state", [&]() { return table->updateInsertSql(data, matchOn); });
+        for (int i = 0; i < plan.placeholders.size(); ++i) {
+            const QString &column = plan.aliases.at(i);
+            if (data.contains(column))
+                query->bindValue(plan.placeholders.at(i), data[column]);
+        }
+        if (!query->exec()) {
+            error = query->lastError().text();
+            db.rollback();
+            return false;
+        }
+    }
+    if (!db.commit()) {
+        error = db.lastError().text();
+        db.rollback();
+        return false;
+    }
+    return true;
+}
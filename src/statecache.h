@@ -0,0 +1,52 @@
+#ifndef STATECACHE_H
+#define STATECACHE_H
+
+#include <QHash>
+#include <QObject>
+#include <QPair>
+#include <QSqlDatabase>
+#include <QThread>
+#include <QTimer>
+#include "databasetables.h"
+
+// Forward declarations
+class DatabaseManager;
+
+class StateCache : public QObject
+{
+    Q_OBJECT
+public:
+    static StateCache *forDatabase(QSqlDatabase db, DatabaseTables *tables);
+    ~StateCache() override;
+
+    bool contains(const QString &object, const QString &propertyName) const;
+    QString value(const QString &object, const QString &propertyName) const;
+    void setValue(const QString &object, const QString &propertyName, const QString &propertyValue);
+    int pending() const;
+    int flushDelay() const;
+    void setFlushDelay(int flushDelay);
+    bool flush();
+    void watch(DatabaseManager *manager);
+
+private:
+    using Key = QPair<QString, QString>;            // Object and property name
+
+    explicit StateCache(QSqlDatabase db, TableSchema *table, QObject *parent = nullptr);
+    bool preload();
+    bool reload(const QStringList &ids);
+    void store(const QSqlQuery &query);
+    void flushBehind();
+    void shutdown();
+    static bool write(QSqlDatabase db, const TableSchema *table, const QHash<Key, QString> &values, QString &error);
+
+    QSqlDatabase m_db;                              // Database object where the States table is located
+    TableSchema *m_table;                           // States table
+    QHash<Key, QString> m_values;                   // Property values by object and property name
+    QHash<QString, Key> m_keys;                     // Object and property name of each row by id
+    QHash<Key, QString> m_pending;                  // Values saved since the last flush, latest value per property
+    QTimer m_flushTimer;                            // Delays writes so that bursts of saves are coalesced
+    QThread m_thread;                               // Worker thread that writes behind
+    QObject *m_worker;                              // Context for work run on the worker thread
+};
+
+#endif // STATECACHE_H
@@ -1,9 +1,27 @@
 #include "tableaccess.h"
+#include "databasemanager.h"
+#include "base/unitofwork.h"
 #include <QSqlQuery>
 #include <QSqlError>
 #include <QRandomGenerator>
 #include <QUuid>
 #include <QDebug>
+#include <algorithm>
+
+namespace {
+/**
+ * @brief Join the error texts of a validation into one message
+ *
+ * @param errors Map of column alias or row number to error text
+ * @returns Error texts separated by semicolons
+ */
+QString errorText(const QVariantMap &errors) {
+    QStringList messages;
+    for (const QVariant &message : errors)
+        messages << message.toString();
+    return messages.join("; ");
+}
+}
 
 /**
  * @brief Table access constructor
@@ -18,6 +36,13 @@
 TableAccess::TableAccess(QSqlDatabase db, DatabaseTables *tables, QString tableName, QObject *parent) : QObject(parent), TableMixin<TableAccess>(db, tables->fetch(tableName)) {
     m_table = tables->fetch(tableName);
     setObjectName(m_table->tableName() + "TableAccess");
+    m_statements = &StatementCache::forDatabase(db);
+    m_originals.setMaxCost(256);
+    // Prepared statements no longer match a schema that has changed
+    connect(m_table, &TableSchema::schemaChanged, this, [this]() {
+        m_statements->invalidate(m_table->tableName() + "/");
+        m_originals.clear();
+    });
 }
 
 /**
@@ -26,15 +51,17 @@ TableAccess::TableAccess(QSqlDatabase db, DatabaseTables *tables, QString tableN
  * @returns Number of records in table, -1 if an error occurred
  */
 int TableAccess::count() {
-    QSqlQuery query(m_db);
+    auto query = m_statements->prepare(statementKey("count"), [this]() { return m_table->countSql(); });
 
-    if (!query.exec(m_table->countSql())) {
-        fail("count(*) failed: " + query.lastError().text());
+    if (!query->exec()) {
+        fail("count(*) failed: " + query->lastError().text());
         return -1;
     }
-    if (query.next()) {
-        success("count(*) successful", query.value(0).toString());
-        return query.value(0).toInt();
+    if (query->next()) {
+        const int count = query->value(0).toInt();
+        query->finish();
+        success("count(*) successful", QString::number(count));
+        return count;
     }
     fail("count(*) failed to retrieve count");
     return -1;
@@ -43,34 +70,287 @@ int TableAccess::count() {
 /**
  * @brief Add new row to database
  *
+ * The row is checked against the column constraints before it is sent.
+ *
  * @param data Variant map containing fields and their associated value
  * @returns True if successful, otherwise false
  */
 bool TableAccess::add(const QVariantMap &data) {
-    QStringList const placeholders = m_table->columnPlaceholders();
-    QString const pKey = m_table->primaryKey(true);
-    QSqlQuery query(m_db);
+    const SchemaPlan &plan = m_table->plan();
+    const QVariantMap invalid = m_table->validate(data);
+    if (!invalid.isEmpty())
+        return fail("add failed: " + errorText(invalid));
     QString guid = QUuid::createUuid().toString(QUuid::WithoutBraces);
 
     // Prepare insert
-    query.prepare(m_table->insertSql(data));
+    auto query = m_statements->prepare(statementKey("insert", data), [&]() { return m_table->insertSql(data); });
 
     // Bind column values.
-    for (const QString &placeholder : placeholders) {
-        const QString name = m_table->toAlias(placeholder);
-        if (placeholder == pKey)
-            query.bindValue(placeholder, guid);
+    for (int i = 0; i < plan.placeholders.size(); ++i) {
+        const QString &name = plan.aliases.at(i);
+        if (i == plan.primaryKey)
+            query->bindValue(plan.placeholders.at(i), guid);
         else if (data.contains(name))
-            query.bindValue(placeholder, data[name]);
+            query->bindValue(plan.placeholders.at(i), data[name]);
     }
 
     // Add row to table
-    if (!query.exec())
-        return fail("add failed: " + query.lastError().text());
+    if (!query->exec())
+        return fail("add failed: " + query->lastError().text());
 
+    defer([this, guid]() { emit rowAdded(guid); });
     return success("added ID:", guid);
 }
 
+/**
+ * @brief Add several rows to database in a single transaction
+ *
+ * Primary keys are generated up front for every row. Rows holding the same
+ * columns are inserted together using multi-row inserts of up to 500 rows.
+ *
+ * Rows are first checked against the column constraints. By default any
+ * invalid row rejects the batch before anything is sent, and the first
+ * database failure rolls back the whole batch, reporting the error against
+ * every row of the chunk that failed. When continuing on error, invalid rows
+ * are skipped and a failed chunk is retried a row at a time within
+ * savepoints so that only the offending rows are skipped. A savepoint that
+ * cannot be set, released or rolled back to fails the whole batch.
+ *
+ * The returned map holds:
+ *      added - Number of rows added
+ *      ids - Generated id of each row, blank for rows that were not added
+ *      errors - Map of row number to error text for rows that failed
+ *
+ * @param rows List of variant maps containing fields and their associated value
+ * @param continueOnError True to skip failed rows instead of rolling back the batch
+ * @returns Variant map describing the outcome of the batch
+ */
+QVariantMap TableAccess::addBatch(const QVariantList &rows, bool continueOnError) {
+    const int chunkSize = this->chunkSize();
+    QMap<QString, QList<int>> shapes;
+    QVariantList ids;
+    QVariantMap errors;
+    int added = 0;
+
+    // Build outcome of batch
+    auto outcome = [&]() {
+        QVariantMap result;
+        result["added"] = added;
+        result["ids"] = added > 0 ? ids : QVariantList();
+        result["errors"] = errors;
+        return result;
+    };
+
+    // Reject invalid rows before sending anything
+    errors = m_table->validate(rows);
+    if (!errors.isEmpty() && !continueOnError) {
+        fail("batch add failed: " + errorText(errors));
+        return outcome();
+    }
+
+    // Generate primary keys and group valid rows holding the same columns
+    ids.reserve(rows.size());
+    for (int row = 0; row < rows.size(); ++row) {
+        if (errors.contains(QString::number(row))) {
+            ids << QString();
+            continue;
+        }
+        ids << QUuid::createUuid().toString(QUuid::WithoutBraces);
+        shapes[statementKey("insert", rows.at(row).toMap())] << row;
+    }
+
+    // Join any unit of work in progress, otherwise run in a transaction of its own
+    UnitOfWork &work = UnitOfWork::forDatabase(m_db);
+    if (!work.begin()) {
+        fail("batch failed to start transaction: " + work.error());
+        return outcome();
+    }
+
+    // Abandon whole batch, reporting error against the rows of the chunk being inserted
+    auto abandon = [&](const QList<int> &chunk, const QString &error) {
+        work.rollback();
+        added = 0;
+        for (int row : chunk)
+            errors[QString::number(row)] = error;
+        fail("batch add failed: " + error);
+        return outcome();
+    };
+
+    // Insert each shape in chunks
+    QSqlQuery savepoint(m_db);
+    for (auto it = shapes.constBegin(); it != shapes.constEnd(); ++it) {
+        const QList<int> &shape = it.value();
+        for (int start = 0; start < shape.size(); start += chunkSize) {
+            const QList<int> chunk = shape.mid(start, chunkSize);
+            QString error;
+
+            if (continueOnError && !savepoint.exec("SAVEPOINT batch_chunk"))
+                return abandon(chunk, savepoint.lastError().text());
+            if (insertRows(rows, ids, chunk, error)) {
+                added += chunk.size();
+                if (continueOnError && !savepoint.exec("RELEASE SAVEPOINT batch_chunk"))
+                    return abandon(chunk, savepoint.lastError().text());
+                continue;
+            }
+
+            // Abandon whole batch on first failure
+            if (!continueOnError)
+                return abandon(chunk, error);
+
+            // Retry failed chunk one row at a time
+            if (!savepoint.exec("ROLLBACK TO SAVEPOINT batch_chunk"))
+                return abandon(chunk, savepoint.lastError().text());
+            for (int row : chunk) {
+                if (!savepoint.exec("SAVEPOINT batch_row"))
+                    return abandon(chunk, savepoint.lastError().text());
+                if (insertRows(rows, ids, { row }, error)) {
+                    if (!savepoint.exec("RELEASE SAVEPOINT batch_row"))
+                        return abandon(chunk, savepoint.lastError().text());
+                    added += 1;
+                } else {
+                    if (!savepoint.exec("ROLLBACK TO SAVEPOINT batch_row"))
+                        return abandon(chunk, savepoint.lastError().text());
+                    errors[QString::number(row)] = error;
+                    ids[row] = QString();
+                }
+            }
+            if (!savepoint.exec("RELEASE SAVEPOINT batch_chunk"))
+                return abandon(chunk, savepoint.lastError().text());
+        }
+    }
+
+    // Commit batch
+    if (!work.commit()) {
+        added = 0;
+        fail("batch commit failed: " + work.error());
+        return outcome();
+    }
+
+    if (added > 0)
+        defer([this]() { emit rowsChanged(); });
+    if (errors.isEmpty())
+        success("batch added rows:", QString::number(added));
+    else
+        fail(QString("batch added %1 rows, %2 failed").arg(added).arg(errors.size()));
+    return outcome();
+}
+
+/**
+ * @brief Update or insert several rows with a single statement
+ *
+ * Rows are staged into a temporary table shaped like the table and then
+ * applied with one statement on the match columns, all in one transaction.
+ * The statement is an INSERT ... ON CONFLICT when the match columns are a
+ * declared unique key of the table, otherwise a MERGE. Every row must hold
+ * the same columns as the first row, apart from the primary key, and rows
+ * must be unique on the match columns. Rows without a primary key are given
+ * one, which is only used when the row is inserted. The inserted and updated
+ * counts are returned by the statement that applied the rows.
+ *
+ * The returned map holds:
+ *      inserted - Number of rows inserted
+ *      updated - Number of existing rows updated
+ *      error - Error text if the upsert failed
+ *
+ * @param rows List of variant maps containing fields and their associated value
+ * @param matchColumns List of column aliases used to locate existing rows
+ * @returns Variant map describing the outcome of the upsert
+ */
+QVariantMap TableAccess::upsertBatch(const QVariantList &rows, const QStringList &matchColumns) {
+    const SchemaPlan &plan = m_table->plan();
+    const int chunkSize = this->chunkSize();
+    const QString pKey = plan.primaryKey >= 0 ? plan.aliases.at(plan.primaryKey) : QString();
+    QVariantList ids;
+    QList<int> all;
+    QVariantMap result;
+    QString error;
+
+    result["inserted"] = 0;
+    result["updated"] = 0;
+    if (rows.isEmpty())
+        return result;
+
+    // Reject invalid rows before sending anything
+    const QVariantMap invalid = m_table->validate(rows);
+    if (!invalid.isEmpty()) {
+        result["error"] = errorText(invalid);
+        fail("bulk upsert failed: " + errorText(invalid));
+        return result;
+    }
+
+    // Every row is bound as shaped by the first, so reject rows holding other columns
+    const QVariantMap shape = rows.first().toMap();
+    for (int row = 1; row < rows.size(); ++row) {
+        const QVariantMap data = rows.at(row).toMap();
+        const bool sameShape = std::all_of(plan.aliases.cbegin(), plan.aliases.cend(), [&](const QString &alias) {
+            return alias == pKey || data.contains(alias) == shape.contains(alias);
+        });
+        if (!sameShape) {
+            const QString message = QString("row %1 holds different columns from row 0").arg(row);
+            result["error"] = message;
+            fail("bulk upsert failed: " + message);
+            return result;
+        }
+    }
+
+    // Keep supplied primary keys, generate the rest
+    ids.reserve(rows.size());
+    for (int row = 0; row < rows.size(); ++row) {
+        const QVariant id = rows.at(row).toMap().value(pKey);
+        ids << (id.isNull() ? QUuid::createUuid().toString(QUuid::WithoutBraces) : id);
+        all << row;
+    }
+
+    // Abandon upsert, reporting error
+    UnitOfWork &work = UnitOfWork::forDatabase(m_db);
+    auto abandon = [&](const QString &message) {
+        work.rollback();
+        result["error"] = message;
+        fail("bulk upsert failed: " + message);
+        return result;
+    };
+
+    // Join any unit of work in progress, otherwise run in a transaction of its own
+    if (!work.begin()) {
+        result["error"] = work.error();
+        fail("bulk upsert failed: " + work.error());
+        return result;
+    }
+
+    // Stage rows, emptying rows left by an earlier upsert in the same unit of work
+    QSqlQuery query(m_db);
+    if (!query.exec(m_table->createStagingSql()) || !query.exec(m_table->clearStagingSql()))
+        return abandon(query.lastError().text());
+    for (int start = 0; start < all.size(); start += chunkSize) {
+        if (!insertRows(rows, ids, all.mid(start, chunkSize), error, true))
+            return abandon(error);
+    }
+
+    // Apply all staged rows, counting inserts and updates
+    const QString matchOn = matchColumns.join(",");
+    auto merge = m_statements->prepare(statementKey("merge:" + matchOn, shape), [&]() { return m_table->mergeStagingSql(shape, matchColumns); });
+    if (!merge->exec() || !merge->next())
+        return abandon(merge->lastError().text());
+    const int inserted = merge->value(0).toInt();
+    const int updated = merge->value(1).toInt();
+    const int merged = inserted + updated;
+    merge->finish();
+
+    // Commit, which also empties the staging table once the outermost scope commits
+    if (!work.commit()) {
+        result["error"] = work.error();
+        fail("bulk upsert failed: " + work.error());
+        return result;
+    }
+
+    result["inserted"] = inserted;
+    result["updated"] = updated;
+    if (merged > 0)
+        defer([this]() { emit rowsChanged(); });
+    success("bulk upsert rows:", QString::number(merged));
+    return result;
+}
+
 /**
  * @brief Retrieve the valid enumerated list of values and their labels for a column
  *
@@ -85,7 +365,8 @@ QVariantMap TableAccess::columnValues(const QString &columnName) {
  * @brief Retrieve row from database
  *
  * The caller is responsible for clearing the variant map if desired. When an empty
- * string is passed as the id, a default record will be returned.
+ * string is passed as the id, a default record will be returned. The values
+ * retrieved are remembered so that a later update only writes changed columns.
  *
  * @param id Id of row to be retrieved from table.
  * @param result Variant map where fields and their associated value will be returned
@@ -99,28 +380,27 @@ QVariantMap TableAccess::get(const QString &id) {
     }
 
     // Variables needed for getting value from database
-    QString const sql = m_table->selectSql();
-    QString const pKey = m_table->primaryKey();
-    QStringList const columns = m_table->columnAliases(true, false);
-    QSqlQuery query(m_db);
+    const SchemaPlan &plan = m_table->plan();
     QVariantMap result;
 
     // Retrieve record from database
-    query.prepare(sql);
-    if (pKey != "")
-        query.bindValue(m_table->primaryKey(true), id);
-    if (!query.exec()) {
-        fail("get failed: " + query.lastError().text());
+    auto query = m_statements->prepare(statementKey("select"), [this]() { return m_table->selectSql(); });
+    if (plan.primaryKey >= 0)
+        query->bindValue(plan.placeholders.at(plan.primaryKey), id);
+    if (!query->exec()) {
+        fail("get failed: " + query->lastError().text());
         return result;
-    } else if (!query.next()) {
+    } else if (!query->next()) {
         fail("id not found: " + id);
         return result;
     }
 
     // Save results into variant map
-    for (const QString& name : columns) {
-        result[name] = query.value(name);
+    for (int i = 0; i < plan.aliases.size(); ++i) {
+        result[plan.aliases.at(i)] = query->value(i);
     }
+    query->finish();
+    m_originals.insert(id, new QVariantMap(result));
 
     success("get ID:", id);
     return result;
@@ -129,31 +409,46 @@ QVariantMap TableAccess::get(const QString &id) {
 /**
  * @brief Update row in database
  *
+ * When the row was retrieved with get(), only the columns whose values differ
+ * from those retrieved are written. An update that changes nothing does not
+ * reach the database and still succeeds. Changed values are checked against
+ * the column constraints before they are sent.
+ *
  * @param id Id of row to be updated in table.
- * @param data Variant map containing fields and their associated value
+ * @param values Variant map containing fields and their associated value
  * @returns True if successful, otherwise false
  */
-bool TableAccess::update(const QString &id, const QVariantMap &data) {
-    QString const sql = m_table->updateSql(data);
-    QString const pKey = m_table->primaryKey(true);
-    QStringList const placeholders = m_table->columnPlaceholders(true);
-    QSqlQuery query(m_db);
+bool TableAccess::update(const QString &id, const QVariantMap &values) {
+    const SchemaPlan &plan = m_table->plan();
+    const QVariantMap data = changedValues(id, values);
+
+    if (data.isEmpty())
+        return success("unchanged ID:", id);
+    const QVariantMap invalid = m_table->validate(data);
+    if (!invalid.isEmpty())
+        return fail("update failed: " + errorText(invalid));
 
     // Prepare query to do update
-    query.prepare(sql);
-    for (const QString& placeholder : placeholders) {
-        const QString column = m_table->toAlias(placeholder);
+    auto query = m_statements->prepare(statementKey("update", data), [&]() { return m_table->updateSql(data); });
+    for (int i = 0; i < plan.placeholders.size(); ++i) {
+        const QString &column = plan.aliases.at(i);
 
-        if (placeholder == pKey)
-            query.bindValue(placeholder, id);
+        if (i == plan.primaryKey)
+            query->bindValue(plan.placeholders.at(i), id);
         else if (data.contains(column))
-            query.bindValue(placeholder, data[column]);
+            query->bindValue(plan.placeholders.at(i), data[column]);
     }
 
     // Update record in database
-    if (!query.exec())
-        return fail("update failed: " + query.lastError().text());
+    if (!query->exec())
+        return fail("update failed: " + query->lastError().text());
 
+    // Remember written values once they are committed
+    defer([this, id, data]() {
+        if (QVariantMap *original = m_originals.object(id))
+            original->insert(data);
+        emit rowUpdated(id);
+    });
     return success("updated ID:", id);
 }
 
@@ -164,17 +459,240 @@ bool TableAccess::update(const QString &id, const QVariantMap &data) {
  * @returns True if successful, otherwise false
  */
 bool TableAccess::remove(const QString &id) {
-    QString const sql = m_table->deleteSql();
-    QString const pKey = m_table->primaryKey(true);
-    QSqlQuery query(m_db);
+    const SchemaPlan &plan = m_table->plan();
 
     // Prepare query to do delete
-    query.prepare(sql);
-    query.bindValue(pKey, id);
+    auto query = m_statements->prepare(statementKey("delete"), [this]() { return m_table->deleteSql(); });
+    query->bindValue(plan.placeholders.at(plan.primaryKey), id);
 
     // Delete record in database
-    if (!query.exec())
-        return fail("delete failed: " + query.lastError().text());
+    if (!query->exec())
+        return fail("delete failed: " + query->lastError().text());
 
+    m_originals.remove(id);
+    defer([this, id]() { emit rowRemoved(id); });
     return success("deleted ID:", id);
 }
+
+/**
+ * @brief Forget values of rows changed by other connections
+ *
+ * An update then writes every column given instead of diffing against
+ * values another session has since changed.
+ *
+ * @param manager Database manager delivering change notifications
+ */
+void TableAccess::watch(DatabaseManager *manager) {
+    connect(manager, &DatabaseManager::rowsNotified, this, [this](const QString &tableName, const QStringList &ids) {
+        if (tableName != m_table->tableName())
+            return;
+        for (const QString &id : ids)
+            m_originals.remove(id);
+    });
+}
+
+/**
+ * @brief Check a row against the column constraints without sending it
+ *
+ * Lets forms report invalid values as they are entered.
+ *
+ * @param data Variant map containing fields and their associated value
+ * @returns Map of column alias to error text, empty if the row is valid
+ */
+QVariantMap TableAccess::validate(const QVariantMap &data) {
+    return m_table->validate(data);
+}
+
+/**
+ * @brief Begin a unit of work on the connection
+ *
+ * Changes made through any table sharing the connection become part of the
+ * unit of work. Their row signals and success notifications are held back
+ * until the outermost unit of work commits. Nested calls open a savepoint.
+ *
+ * @returns True if successful, otherwise false
+ */
+bool TableAccess::begin() {
+    UnitOfWork &work = UnitOfWork::forDatabase(m_db);
+    if (!work.begin())
+        return fail(work.error());
+    return success("began unit of work, depth", QString::number(work.depth()));
+}
+
+/**
+ * @brief Commit the innermost unit of work
+ *
+ * @returns True if successful, otherwise false
+ */
+bool TableAccess::commit() {
+    UnitOfWork &work = UnitOfWork::forDatabase(m_db);
+    if (!work.commit())
+        return fail(work.error());
+    return success("committed unit of work, depth", QString::number(work.depth()));
+}
+
+/**
+ * @brief Roll back the innermost unit of work
+ *
+ * @returns True if successful, otherwise false
+ */
+bool TableAccess::rollback() {
+    UnitOfWork &work = UnitOfWork::forDatabase(m_db);
+    if (!work.rollback())
+        return fail(work.error());
+    return success("rolled back unit of work, depth", QString::number(work.depth()));
+}
+
+/**
+ * @brief Set a named savepoint within the unit of work
+ *
+ * @param name Savepoint name, letters, digits and underscores only
+ * @returns True if successful, otherwise false
+ */
+bool TableAccess::savepoint(const QString &name) {
+    UnitOfWork &work = UnitOfWork::forDatabase(m_db);
+    if (!work.savepoint(name))
+        return fail(work.error());
+    return success("set savepoint", name);
+}
+
+/**
+ * @brief Undo the changes made since a named savepoint
+ *
+ * @param name Savepoint name
+ * @returns True if successful, otherwise false
+ */
+bool TableAccess::rollbackTo(const QString &name) {
+    UnitOfWork &work = UnitOfWork::forDatabase(m_db);
+    if (!work.rollbackTo(name))
+        return fail(work.error());
+    return success("rolled back to savepoint", name);
+}
+
+/**
+ * @brief Release a named savepoint, keeping the changes made since it was set
+ *
+ * @param name Savepoint name
+ * @returns True if successful, otherwise false
+ */
+bool TableAccess::release(const QString &name) {
+    UnitOfWork &work = UnitOfWork::forDatabase(m_db);
+    if (!work.release(name))
+        return fail(work.error());
+    return success("released savepoint", name);
+}
+
+/**
+ * @brief Keep the values that differ from those last retrieved for a row
+ *
+ * Values are compared as stored, so a number edited as text matches the
+ * number it was retrieved as. Without retrieved values every value is kept.
+ *
+ * @param id Id of row
+ * @param data Variant map containing fields and their associated value
+ * @returns Variant map of changed fields, empty when nothing changed
+ */
+QVariantMap TableAccess::changedValues(const QString &id, const QVariantMap &data) {
+    const QVariantMap *original = m_originals.object(id);
+    if (!original)
+        return data;
+
+    const QString primaryKey = m_table->primaryKey();
+    QVariantMap changed;
+    for (auto it = data.constBegin(); it != data.constEnd(); ++it) {
+        if (it.key() == primaryKey || !original->contains(it.key()))
+            continue;
+
+        const QVariant before = original->value(it.key());
+        const QVariant &after = it.value();
+        bool same = before.isNull() == after.isNull();
+        if (same && !before.isNull())
+            same = before == after || (before.metaType() != after.metaType() && before.toString() == after.toString());
+        if (!same)
+            changed.insert(it.key(), after);
+    }
+    return changed;
+}
+
+/**
+ * @brief Number of rows inserted by one multi-row insert
+ *
+ * Up to 500 rows are inserted at a time, fewer when the table has so many
+ * columns that the statement would exceed the 65535 bind parameter limit.
+ *
+ * @returns Rows per chunk
+ */
+int TableAccess::chunkSize() const {
+    return qBound(1, 65535 / qMax(1, m_table->plan().aliases.size()), 500);
+}
+
+/**
+ * @brief Insert a chunk of rows holding the same columns with a single statement
+ *
+ * Only full chunks and single rows are kept in the statement cache. A tail
+ * chunk of any other size is prepared for this call alone, so the server
+ * does not hold a statement for every chunk size ever inserted.
+ *
+ * @param rows List of variant maps containing fields and their associated value
+ * @param ids Primary key for each row
+ * @param chunk Row numbers to be inserted
+ * @param error Returns error text when the insert fails
+ * @param staging True to insert into the staging table instead of the table
+ * @returns True if successful, otherwise false
+ */
+bool TableAccess::insertRows(const QVariantList &rows, const QVariantList &ids, const QList<int> &chunk, QString &error, bool staging) {
+    const SchemaPlan &plan = m_table->plan();
+    const QVariantMap shape = rows.at(chunk.first()).toMap();
+    const QString operation = QString(staging ? "stage%1" : "batch%1").arg(chunk.size());
+
+    // Prepare multi-row insert
+    std::shared_ptr<QSqlQuery> query;
+    if (chunk.size() == 1 || chunk.size() == chunkSize()) {
+        query = m_statements->prepare(statementKey(operation, shape), [&]() { return m_table->insertSql(shape, chunk.size(), staging); });
+    } else {
+        query = std::make_shared<QSqlQuery>(m_db);
+        query->prepare(m_table->insertSql(shape, chunk.size(), staging));
+    }
+
+    // Bind column values of each row
+    for (int row = 0; row < chunk.size(); ++row) {
+        const QVariantMap data = rows.at(chunk.at(row)).toMap();
+        const QString suffix = QString("_%1").arg(row);
+        for (int i = 0; i < plan.placeholders.size(); ++i) {
+            const QString &name = plan.aliases.at(i);
+            if (i == plan.primaryKey)
+                query->bindValue(plan.placeholders.at(i) + suffix, ids.at(chunk.at(row)));
+            else if (data.contains(name))
+                query->bindValue(plan.placeholders.at(i) + suffix, data[name]);
+        }
+    }
+
+    if (!query->exec()) {
+        error = query->lastError().text();
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Build the statement cache key for an operation
+ *
+ * The key is made of the table name, the operation and, when data is
+ * provided, a flag for each column telling whether the data holds a value
+ * for it. Statements generated from data with the same columns share a key.
+ *
+ * @param operation Name of operation e.g. "insert"
+ * @param data Variant map whose columns shape the statement
+ * @returns Statement key
+ */
+QString TableAccess::statementKey(const QString &operation, const QVariantMap &data) const {
+    QString shape;
+
+    if (!data.isEmpty()) {
+        const QStringList &aliases = m_table->plan().aliases;
+        shape.reserve(aliases.size());
+        for (const QString &alias : aliases)
+            shape += data.contains(alias) ? QLatin1Char('1') : QLatin1Char('0');
+    }
+    return QString("%1/%2/%3").arg(m_table->tableName(), operation, shape);
+}
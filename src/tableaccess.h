@@ -1,13 +1,18 @@
 #ifndef TABLEACCESS_H
 #define TABLEACCESS_H
 
+#include <QCache>
 #include <QObject>
 #include <QSqlDatabase>
 #include <QVariantMap>
 #include <QtQml/qqmlregistration.h>
+#include "base/statementcache.h"
 #include "base/tablemixin.h"
 #include "databasetables.h"
 
+// Forward declarations
+class DatabaseManager;
+
 class TableAccess : public QObject, public TableMixin<TableAccess>
 {
     Q_OBJECT
@@ -18,10 +23,22 @@ public:
 
     Q_INVOKABLE int count();
     Q_INVOKABLE bool add(const QVariantMap &data);
+    Q_INVOKABLE QVariantMap addBatch(const QVariantList &rows, bool continueOnError = false);
+    Q_INVOKABLE QVariantMap upsertBatch(const QVariantList &rows, const QStringList &matchColumns);
     Q_INVOKABLE QVariantMap columnValues(const QString &columnName);
     Q_INVOKABLE QVariantMap get(const QString &id);
     Q_INVOKABLE bool update(const QString &id, const QVariantMap &data);
     Q_INVOKABLE bool remove(const QString &id);
+    Q_INVOKABLE QVariantMap validate(const QVariantMap &data);
+    void watch(DatabaseManager *manager);
+
+    // Unit of work shared by every table on the connection
+    Q_INVOKABLE bool begin();
+    Q_INVOKABLE bool commit();
+    Q_INVOKABLE bool rollback();
+    Q_INVOKABLE bool savepoint(const QString &name);
+    Q_INVOKABLE bool rollbackTo(const QString &name);
+    Q_INVOKABLE bool release(const QString &name);
 
     // Expose signal emitters for the mixin
     void emitSuccess(const QString &message, const QString &id) {
@@ -34,7 +51,19 @@ public:
 signals:
     void operationSuccess(const QString &message, const QString &id);
     void operationFailed(const QString &error);
+    void rowAdded(const QString &id);
+    void rowUpdated(const QString &id);
+    void rowRemoved(const QString &id);
+    void rowsChanged();
+
+protected:
+    QString statementKey(const QString &operation, const QVariantMap &data = QVariantMap()) const;
+    QVariantMap changedValues(const QString &id, const QVariantMap &data);
+    int chunkSize() const;
+    bool insertRows(const QVariantList &rows, const QVariantList &ids, const QList<int> &chunk, QString &error, bool staging = false);
 
+    StatementCache *m_statements;                   // Prepared statements of the connection
+    QCache<QString, QVariantMap> m_originals;       // Values last read or written by id, for updating changed columns only
 };
 
 #endif // TABLEACCESS_H
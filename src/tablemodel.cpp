@@ -1,8 +1,32 @@
 #include "tablemodel.h"
+#include "databasemanager.h"
 #include <QSqlQuery>
 #include <QSqlError>
 #include <QSqlRecord>
+#include <QSet>
+#include <QSqlDriver>
+#include <QSqlField>
+#include <QMetaObject>
+#include <QRegularExpression>
 #include <QDebug>
+#include <algorithm>
+#include <numeric>
+
+namespace {
+constexpr int maxDiffMoves = 100;                   // Moved rows beyond which a refresh resets the model instead
+const QHash<QString, FilterOperator> filterOperators = { // Filter operators by name used in QML
+    { "equals",         FilterOperator::Equals },
+    { "notEquals",      FilterOperator::NotEquals },
+    { "lessThan",       FilterOperator::LessThan },
+    { "greaterThan",    FilterOperator::GreaterThan },
+    { "atMost",         FilterOperator::LessThanOrEqual },
+    { "atLeast",        FilterOperator::GreaterThanOrEqual },
+    { "like",           FilterOperator::Like },
+    { "in",             FilterOperator::In },
+    { "isNull",         FilterOperator::IsNull },
+    { "isNotNull",      FilterOperator::IsNotNull }
+};
+}
 
 /**
  * @brief Table access constructor
@@ -15,8 +39,10 @@
  * @param parent Reference to parent class.
  */
 TableModel::TableModel(QSqlDatabase db, DatabaseTables *tables, QString tableName, QObject *parent) : QAbstractTableModel(parent), TableMixin<TableModel>(db, tables->fetch(tableName)) {
+    static int windowCount = 0;
     m_table = tables->fetch(tableName);
     setObjectName(m_table->tableName() + "TableModel");
+    m_cursorName = QString("%1_window_%2").arg(m_table->tableName(true)).arg(++windowCount);
     // Initialize state
     m_state = new State(db, tables, objectName(), parent);
     // Get/set default sort column, sort order, visible columns
@@ -33,6 +59,21 @@ TableModel::TableModel(QSqlDatabase db, DatabaseTables *tables, QString tableNam
         m_sortColumn = m_table->defaultSort();
         m_sortOrder = Qt::AscendingOrder;
     }
+    indexVisibleColumns();
+    m_projection = projection();
+    m_rows = RowStore(m_table->columns(), true, m_projection);
+    // Restore filters, dropping any on columns that no longer exist
+    for (const QVariant &filter : m_state->restoreVariantList("filters", {})) {
+        const QVariantMap map = filter.toMap();
+        if (filterColumnIndex(map.value("column").toString()) >= 0)
+            m_filters << map;
+    }
+    // Coalesce bursts of filter changes
+    m_filterTimer.setSingleShot(true);
+    m_filterTimer.setInterval(300);
+    connect(&m_filterTimer, &QTimer::timeout, this, &TableModel::applyFilters);
+    // Poll for changed rows once an interval is set
+    connect(&m_pollTimer, &QTimer::timeout, this, &TableModel::refreshChanges);
 }
 
 /**
@@ -43,13 +84,16 @@ TableModel::TableModel(QSqlDatabase db, DatabaseTables *tables, QString tableNam
  * @returns Requested data or an empty QVariant
  */
 QVariant TableModel::data(const QModelIndex &index, int role) const {
+    const RowStore *rows = nullptr;
     int columnIndex = -1;
+    int offset = -1;
 
     // Retrieve requested information
     switch (role) {
     case CellDataRole:
         columnIndex = columnToIndex(index.column());
-        return m_data.at(index.row()).at(columnIndex);
+        rows = rowAt(index.row(), offset);
+        return rows ? rows->text(offset, columnIndex) : QVariant();
     case CellNameRole:
         return m_visibleColumns.at(index.column());
     case RowRole:
@@ -57,7 +101,8 @@ QVariant TableModel::data(const QModelIndex &index, int role) const {
     case ColumnRole:
         return index.column();
     case IdRole:
-        return m_data.at(index.row()).at(m_table->columnAliases(true, true).indexOf(m_table->primaryKey()));
+        rows = rowAt(index.row(), offset);
+        return rows ? rows->text(offset, m_table->plan().primaryKey) : QVariant();
     default:
         break;
     }
@@ -82,7 +127,7 @@ QVariant TableModel::headerData(int section, Qt::Orientation orientation, int ro
     {
         if (orientation == Qt::Horizontal) {
             columnIndex = columnToIndex(section);
-            return m_table->columnTitles().at(columnIndex);
+            return m_table->plan().titles.at(columnIndex);
         } else if (orientation == Qt::Vertical) {
             return QVariant::fromValue(section + 1);
         }
@@ -136,7 +181,31 @@ int TableModel::columnCount(const QModelIndex &parent) const {
  */
 int TableModel::rowCount(const QModelIndex &parent) const {
     Q_UNUSED(parent)
-    return m_data.size();
+    if (m_cursorOpen)
+        return m_rowCount;
+    return m_diffing ? m_rowMap.size() : m_rows.rowCount();
+}
+
+/**
+ * @brief Determine if more rows can be loaded
+ *
+ * @param parent Parent for which rows are to be loaded (not used)
+ * @returns True when paging and the last page has not yet been loaded
+ */
+bool TableModel::canFetchMore(const QModelIndex &parent) const {
+    if (parent.isValid())
+        return false;
+    return m_pageSize > 0 && !m_cursorOpen && !m_loading && !m_atEnd;
+}
+
+/**
+ * @brief Load the next page of rows
+ *
+ * @param parent Parent for which rows are to be loaded (not used)
+ */
+void TableModel::fetchMore(const QModelIndex &parent) {
+    if (canFetchMore(parent))
+        fetchPage("");
 }
 
 /**
@@ -163,7 +232,7 @@ QString TableModel::sortColumn() {
  * @returns List of column names
  */
 QStringList TableModel::columnNames() const {
-    return m_table->columnAliases(true, true);
+    return m_table->plan().labelAliases;
 }
 
 /**
@@ -172,7 +241,7 @@ QStringList TableModel::columnNames() const {
  * @returns List of column titles
  */
 QStringList TableModel::columnTitles() const {
-    return m_table->columnTitles(true);
+    return m_table->plan().titles;
 }
 
 /**
@@ -193,13 +262,238 @@ QStringList TableModel::visibleColumns() const {
     return m_visibleColumns;
 }
 
+/**
+ * @brief Get number of rows loaded per page
+ *
+ * @returns Rows per page or 0 when the whole table is loaded at once
+ */
+int TableModel::pageSize() const {
+    return m_pageSize;
+}
+
+/**
+ * @brief Determine if only a window of rows is kept in memory
+ *
+ * @returns True when windowed, otherwise false
+ */
+bool TableModel::windowed() const {
+    return m_windowed;
+}
+
+/**
+ * @brief Get maximum number of row blocks kept in memory when windowed
+ *
+ * @returns Number of blocks
+ */
+int TableModel::blockBudget() const {
+    return m_blocks.blockBudget();
+}
+
+/**
+ * @brief Set number of rows loaded per page
+ *
+ * The new page size takes effect on the next refresh.
+ *
+ * @param pageSize Rows per page or 0 to load the whole table at once
+ */
+void TableModel::setPageSize(int pageSize) {
+    pageSize = qMax(0, pageSize);
+    if (m_pageSize != pageSize) {
+        m_pageSize = pageSize;
+        emit pageSizeChanged();
+    }
+}
+
+/**
+ * @brief Set windowed mode
+ *
+ * When windowed, the total row count is known up front and only blocks of
+ * page size rows around the viewport are kept in memory. Blocks are read
+ * by the background loader from a server-side scroll cursor on its own
+ * connection, so any part of the table can be reached without reading the
+ * rows above it. Windowed models are always loaded asynchronously. The new
+ * mode takes effect on the next refresh.
+ *
+ * @param windowed True to keep only a window of rows in memory
+ */
+void TableModel::setWindowed(bool windowed) {
+    if (m_windowed != windowed) {
+        m_windowed = windowed;
+        emit windowedChanged();
+    }
+    if (windowed)
+        setAsync(true);
+}
+
+/**
+ * @brief Set maximum number of row blocks kept in memory when windowed
+ *
+ * At least three blocks are kept so that a viewport straddling two blocks
+ * and the prefetched block can be resident together.
+ *
+ * @param blockBudget Number of blocks
+ */
+void TableModel::setBlockBudget(int blockBudget) {
+    blockBudget = qMax(3, blockBudget);
+    if (m_blocks.blockBudget() != blockBudget) {
+        m_blocks.setBlockBudget(blockBudget);
+        emit blockBudgetChanged();
+    }
+}
+
+/**
+ * @brief Determine if the model is loaded in the background
+ *
+ * @returns True when loaded asynchronously, otherwise false
+ */
+bool TableModel::async() const {
+    return m_loader != nullptr;
+}
+
+/**
+ * @brief Determine if a background load is outstanding
+ *
+ * @returns True while loading, otherwise false
+ */
+bool TableModel::loading() const {
+    return m_loading;
+}
+
+/**
+ * @brief Get column filters
+ *
+ * @returns List of filters, each a map of column, op and value
+ */
+QVariantList TableModel::filters() const {
+    return m_filters;
+}
+
+/**
+ * @brief Determine if refreshes are applied as differences
+ *
+ * @returns True when diffing, otherwise false
+ */
+bool TableModel::diffRefresh() const {
+    return m_diffRefresh;
+}
+
+/**
+ * @brief Get interval between polls for changed rows
+ *
+ * @returns Milliseconds between polls, 0 when not polling
+ */
+int TableModel::pollInterval() const {
+    return m_pollTimer.isActive() ? m_pollTimer.interval() : 0;
+}
+
+/**
+ * @brief Get the most rows sorted in memory
+ *
+ * @returns Number of rows, 0 when always sorted by the database
+ */
+int TableModel::clientSortLimit() const {
+    return m_clientSortLimit;
+}
+
+/**
+ * @brief Set asynchronous loading
+ *
+ * When asynchronous, refresh returns immediately and the rows are queried
+ * and decoded on a worker thread using its own connection. The model is
+ * reset once in a single batch when the rows arrive and loaded is emitted
+ * with the index of the located record. A refresh made while a load is
+ * outstanding supersedes it. Turning asynchronous loading off also turns
+ * windowed mode off, since the scroll cursor lives on the loader's
+ * connection, and discards the open window.
+ *
+ * @param async True to load in the background
+ */
+void TableModel::setAsync(bool async) {
+    if ((m_loader != nullptr) == async)
+        return;
+    if (async) {
+        m_loader = new ModelLoader(m_db.connectionName(), [this](ModelLoader::Result &result) { finishLoad(result); }, this);
+        m_loader->setBlockHandler([this](ModelLoader::Block &block) { finishBlock(block); });
+    } else {
+        if (m_windowed) {
+            m_windowed = false;
+            emit windowedChanged();
+        }
+        if (m_cursorOpen) {
+            beginResetModel();
+            closeWindow();
+            endResetModel();
+        }
+        delete m_loader;
+        m_loader = nullptr;
+        if (m_loading) {
+            m_loading = false;
+            emit loadingChanged();
+        }
+    }
+    emit asyncChanged();
+}
+
+/**
+ * @brief Set diff refresh mode
+ *
+ * When set, a refresh compares the new result set with the loaded rows by
+ * primary key and signals only the rows removed, moved, inserted or changed,
+ * and visible column changes signal only the columns removed or inserted.
+ * Views keep their delegates and scroll position. Diffing needs the whole
+ * result set, so it applies to unpaged and background loads; paged and
+ * windowed refreshes still reset the model.
+ *
+ * @param diffRefresh True to apply refreshes as differences
+ */
+void TableModel::setDiffRefresh(bool diffRefresh) {
+    if (m_diffRefresh != diffRefresh) {
+        m_diffRefresh = diffRefresh;
+        emit diffRefreshChanged();
+    }
+}
+
+/**
+ * @brief Set interval between polls for changed rows
+ *
+ * Each poll calls refreshChanges().
+ *
+ * @param pollInterval Milliseconds between polls or 0 to stop polling
+ */
+void TableModel::setPollInterval(int pollInterval) {
+    pollInterval = qMax(0, pollInterval);
+    if (this->pollInterval() == pollInterval)
+        return;
+    if (pollInterval > 0)
+        m_pollTimer.start(pollInterval);
+    else
+        m_pollTimer.stop();
+    emit pollIntervalChanged();
+}
+
+/**
+ * @brief Set the most rows sorted in memory
+ *
+ * When the whole result set is loaded and holds no more than this many
+ * rows, sortBy() reorders the loaded rows instead of querying again.
+ *
+ * @param clientSortLimit Number of rows or 0 to always sort in the database
+ */
+void TableModel::setClientSortLimit(int clientSortLimit) {
+    clientSortLimit = qMax(0, clientSortLimit);
+    if (m_clientSortLimit != clientSortLimit) {
+        m_clientSortLimit = clientSortLimit;
+        emit clientSortLimitChanged();
+    }
+}
+
 /**
  * @brief Set list of visible column names
  *
  * @param columns List of visible column names
  */
 void TableModel::setVisibleColumns(const QStringList &columns) {
-    const QStringList allColumns = m_table->columnAliases(true, true);
+    const QStringList &allColumns = m_table->plan().labelAliases;
     QStringList newColumns;
 
     // Validate and transfer columns to new column list
@@ -209,32 +503,127 @@ void TableModel::setVisibleColumns(const QStringList &columns) {
 
     // On change in list
     if (m_visibleColumns != newColumns) {
-        m_visibleColumns = newColumns;
+        // Load only the newly visible columns that are not loaded yet
+        QList<int> missing;
+        for (const QString &name : std::as_const(newColumns)) {
+            const int index = m_table->ordinal(name, true);
+            if (!m_projection.contains(index))
+                missing << index;
+        }
+        const bool reload = !missing.isEmpty() && (m_cursorOpen || m_loading || !fillColumns(missing));
+
+        if (m_diffRefresh)
+            applyColumns(newColumns);
+        else {
+            // Trigger layout change
+            beginResetModel();
+            m_visibleColumns = newColumns;
+            indexVisibleColumns();
+            endResetModel();
+        }
         m_state->save("visibleColumns", m_visibleColumns);
         emit visibleColumnsChanged();
-        // Trigger layout change
-        beginResetModel();
-        endResetModel();
+        if (reload)
+            refresh("");
+    }
+}
+
+/**
+ * @brief Replace all column filters
+ *
+ * Each filter is a map of column (alias), op and value. The op is one of equals,
+ * notEquals, lessThan, greaterThan, atMost, atLeast, like (case insensitive,
+ * with % wildcards), in (value is a list), isNull, isNotNull or between (value
+ * is a list of lower and upper bound, either of which may be null). Filters on
+ * different columns are and'ed together. The model is refreshed once filter
+ * changes stop arriving and the filters are saved with the other state.
+ *
+ * @param filters List of filters
+ */
+void TableModel::setFilters(const QVariantList &filters) {
+    QVariantList newFilters;
+
+    // Keep only filters on known columns using known operators
+    for (const QVariant &filter : filters) {
+        const QVariantMap map = filter.toMap();
+        const QString op = map.value("op").toString();
+        if (filterColumnIndex(map.value("column").toString()) < 0)
+            qWarning() << "Unknown column used for filter:" << map.value("column").toString();
+        else if (op != "between" && !filterOperators.contains(op))
+            qWarning() << "Unknown filter operator:" << op;
+        else
+            newFilters << map;
+    }
+
+    if (m_filters != newFilters) {
+        m_filters = newFilters;
+        emit filtersChanged();
+        m_filterTimer.start();
+    }
+}
+
+/**
+ * @brief Set the filter on a column
+ *
+ * Any existing filter on the column is replaced.
+ *
+ * @param column Column alias
+ * @param op Filter operator, see setFilters()
+ * @param value Value compared against, not used by the null checks
+ */
+void TableModel::setFilter(const QString &column, const QString &op, const QVariant &value) {
+    QVariantList filters;
+    for (const QVariant &filter : std::as_const(m_filters)) {
+        if (filter.toMap().value("column").toString() != column)
+            filters << filter;
+    }
+    filters << QVariantMap { { "column", column }, { "op", op }, { "value", value } };
+    setFilters(filters);
+}
+
+/**
+ * @brief Remove the filter on a column
+ *
+ * @param column Column alias
+ */
+void TableModel::removeFilter(const QString &column) {
+    QVariantList filters;
+    for (const QVariant &filter : std::as_const(m_filters)) {
+        if (filter.toMap().value("column").toString() != column)
+            filters << filter;
     }
+    setFilters(filters);
+}
+
+/**
+ * @brief Remove all column filters
+ */
+void TableModel::clearFilters() {
+    setFilters({});
 }
 
 /**
  * @brief Reload the model in the requested order
  *
+ * When the whole result set is loaded and within the client sort limit,
+ * the loaded rows are sorted in memory instead.
+ *
  * @param sortColumn Column on which data is to be sorted
  * @param id Value of id of record to be located
  * @returns Index to found record or -1 if not found
  */
 int TableModel::sortBy(const QString sortColumn, const QString &id) {
-    const QStringList allColumns = m_table->columnAliases(true, true);
+    const SchemaPlan &plan = m_table->plan();
+    const QString previousColumn = m_sortColumn;
+    const Qt::SortOrder previousOrder = m_sortOrder;
 
     // Toggle sort order if same column selected
     if (sortColumn != "" && sortColumn == m_sortColumn)
         m_sortOrder = (m_sortOrder == Qt::AscendingOrder) ? Qt::DescendingOrder : Qt::AscendingOrder;
     else {
         // Validate sort order
-        if (!allColumns.contains(sortColumn)) {
-            m_sortColumn = allColumns.at(0);
+        if (!plan.labelOrdinals.contains(sortColumn)) {
+            m_sortColumn = plan.labelAliases.at(0);
             qWarning() << "Unknown column used for sort order:" << sortColumn;
         } else
             m_sortColumn = sortColumn;
@@ -247,54 +636,1117 @@ int TableModel::sortBy(const QString sortColumn, const QString &id) {
     m_state->save("sortOrder", m_sortOrder);
     // Notify interface that order has changed
     emit sortOrderChanged();
+    if (sortRows(previousColumn, previousOrder))
+        return id.isEmpty() ? -1 : rowOf(id);
     return refresh(id);
 }
 
 /**
  * @brief Reload the model using the current properties
  *
+ * When paging, only the first page is loaded unless a record is to be
+ * located, in which case pages are loaded until that record is found.
+ * When windowed, the loader reopens the scroll cursor and reads the block
+ * holding the record. When loading asynchronously, the current rows stay
+ * in place until the new rows arrive and the index is reported through
+ * the loaded signal instead.
+ *
  * @param id Value of id of record to be located
- * @returns Index to found record or -1 if not found
+ * @returns Index to found record or -1 if not found or loading asynchronously
  */
 int TableModel::refresh(const QString &id) {
-    const QStringList allColumns = m_table->columnAliases(true, true);
-    const QString pKey = m_table->primaryKey();
-    QSqlQuery query(m_db);
     int foundIdx = -1;
-    int index = -1;
+
+    // Changes are read from the watermark taken before the rows, by the loader when there is one
+    m_watermark = -1;
+
+    // Hand load to the background loader
+    if (m_loader) {
+        startLoad(id);
+        return foundIdx;
+    }
+    if (m_table->rowVersioning() && readWatermark(m_watermark))
+        m_watermarkAge.start();
+
+    m_keyRowsValid = false;
+
+    m_projection = projection();
+
+    // Load whole result set and apply only the differences
+    if (m_diffRefresh && !m_cursorOpen && m_pageSize <= 0) {
+        RowStore rows(m_table->columns(), true, m_projection);
+        if (selectRows(rows, id, foundIdx)) {
+            applyRows(rows);
+            success("successful query by", m_sortColumn);
+        }
+        return foundIdx;
+    }
 
     // Prepare to load result set
     beginResetModel();
-    m_data.clear();
+    closeWindow();
+    m_rows = RowStore(m_table->columns(), true, m_projection);
+    m_cursor = KeysetCursor();
+    m_atEnd = m_pageSize <= 0;
+
+    // Load pages through the requested record in one query
+    if (m_pageSize > 0) {
+        endResetModel();
+        m_error.clear();
+        const int position = id.isEmpty() ? -1 : locate(id);
+        foundIdx = fetchPage(id, position < 0 ? m_pageSize : (position / m_pageSize + 1) * m_pageSize);
+        if (m_error.isEmpty())
+            success("successful query by", m_sortColumn);
+        return foundIdx;
+    }
+
+    // Load whole result set
+    const bool loaded = selectRows(m_rows, id, foundIdx);
+    endResetModel();
+    if (loaded)
+        success("successful query by", m_sortColumn);
+
+    return foundIdx;
+}
+
+/**
+ * @brief Reload the records changed since the rows were loaded
+ *
+ * Only the keys of rows changed or deleted since the watermark are read,
+ * and those records are patched in place. The model is refreshed instead
+ * when the table is not versioned, the rows have not been loaded, or the
+ * watermark is older than half the tombstone horizon, which leaves a margin
+ * for transactions that ran long before deleting rows.
+ *
+ * @returns Number of records changed or -1 if the model was refreshed or the query failed
+ */
+int TableModel::refreshChanges() {
+    if (m_loading)
+        return 0;
+    if (m_watermark < 0 || m_watermarkAge.elapsed() > m_table->tombstoneHorizon() * 500LL) {
+        refresh("");
+        return -1;
+    }
+
+    // Take the next watermark before reading the changes
+    qint64 watermark = -1;
+    if (!readWatermark(watermark))
+        return -1;
+
+    QSqlQuery query(m_db);
+    const QString sql = m_table->changedKeysSql();
+    query.setForwardOnly(true);
+    query.prepare(sql);
+    query.bindValue(":watermark", m_watermark);
+    if (!query.exec()) {
+        qDebug() << sql;
+        fail("failed changes query:" + query.lastError().text());
+        return -1;
+    }
+    QStringList ids;
+    while (query.next())
+        ids << query.value(0).toString();
+
+    m_watermark = watermark;
+    m_watermarkAge.start();
+    patchRows(ids);
+    return ids.size();
+}
+
+/**
+ * @brief Sort the loaded rows in memory into the current order
+ *
+ * This only applies when the whole result set is loaded and within the
+ * client sort limit. A change of direction on the same column reverses the
+ * rows. Otherwise the rows are sorted on the new column, which is loaded
+ * first if it was left out of the loaded rows.
+ *
+ * @param previousColumn Sort column the rows are currently ordered on
+ * @param previousOrder Sort order the rows are currently ordered in
+ * @returns True if the rows were sorted, false if they must be reloaded
+ */
+bool TableModel::sortRows(const QString &previousColumn, Qt::SortOrder previousOrder) {
+    const int rowCount = m_rows.rowCount();
+    if (rowCount > m_clientSortLimit || !m_atEnd || m_windowed || m_cursorOpen || m_loading || m_diffing)
+        return false;
+
+    // Compute the stored row for each position
+    QVector<int> order;
+    if (m_sortColumn == previousColumn) {
+        if (m_sortOrder == previousOrder)
+            return true;
+        order.resize(rowCount);
+        std::iota(order.rbegin(), order.rend(), 0);
+    } else {
+        const int sortIndex = m_table->ordinal(m_sortColumn, true);
+        if (!m_rows.isLoaded(sortIndex) && !fillColumns({ sortIndex }))
+            return false;
+        order = m_rows.sortedRows(sortIndex, m_table->plan().primaryKey);
+        if (m_sortOrder == Qt::DescendingOrder)
+            std::reverse(order.begin(), order.end());
+    }
+
+    // Reorder rows, keeping persistent indexes on the same records
+    emit layoutAboutToBeChanged({}, QAbstractItemModel::VerticalSortHint);
+    QVector<int> positions(rowCount);
+    for (int position = 0; position < rowCount; ++position)
+        positions[order.at(position)] = position;
+    const QModelIndexList persistent = persistentIndexList();
+    QModelIndexList moved;
+    moved.reserve(persistent.size());
+    for (const QModelIndex &index : persistent)
+        moved << this->index(positions.at(index.row()), index.column());
+    changePersistentIndexList(persistent, moved);
+    m_rows.permute(order);
+    m_keyRowsValid = false;
+    emit layoutChanged({}, QAbstractItemModel::VerticalSortHint);
+
+    success("sorted in memory by", m_sortColumn);
+    return true;
+}
+
+/**
+ * @brief Load the whole filtered and sorted result set
+ *
+ * @param rows Store to which the rows are appended
+ * @param id Value of id of record to be located
+ * @param foundIdx Returns index to found record or -1 if not found
+ * @returns True if successful, otherwise false
+ */
+bool TableModel::selectRows(RowStore &rows, const QString &id, int &foundIdx) {
+    const int keyIndex = m_table->plan().primaryKey;
+    QSqlQuery query(m_db);
 
     // Prepare query
-    const QString sql = m_table->selectSql({}, m_sortColumn, m_sortOrder, true);
+    const QList<FilterCondition> filters = filterConditions();
+    const QVariantMap values = m_table->filterValues(filters);
+    const QString sql = m_table->selectSql(filters, m_sortColumn, m_sortOrder, true, rows.projection());
+    query.setForwardOnly(true);
     query.prepare(sql);
+    for (auto it = values.constBegin(); it != values.constEnd(); ++it)
+        query.bindValue(it.key(), it.value());
     if (!query.exec()) {
         qDebug() << sql;
-        fail( "failed query:" + query.lastError().text());
-        endResetModel();
-        return foundIdx;
+        return fail("failed query:" + query.lastError().text());
     }
 
     // Save result set
     while (query.next()) {
-        QList<QString> v;
-        index += 1;
-        for (const QString &name : allColumns) {
-            if (name == pKey && query.value(name) == id) {
-                foundIdx = index;
-            }
-            v << query.value(name).toString();
+        rows.append(query);
+        if (foundIdx < 0 && !id.isEmpty() && rows.text(rows.rowCount() - 1, keyIndex) == id)
+            foundIdx = rows.rowCount() - 1;
+    }
+    return true;
+}
+
+/**
+ * @brief Replace the loaded rows by signalling only the differences
+ *
+ * The old and new rows are held side by side while model rows are mapped
+ * onto them, so that the model is consistent after every signal:
+ * 1. Rows no longer present are removed in runs from the bottom up.
+ * 2. Rows that changed position are moved, leaving the longest run of rows
+ *    already in order in place so that one edited row costs one move. When
+ *    many rows moved the model is reset instead.
+ * 3. New rows are inserted in runs and rows whose values changed are
+ *    reported in runs.
+ * Finally the new rows replace the old without further signals.
+ *
+ * @param rows New result set, in sort order
+ */
+void TableModel::applyRows(RowStore &rows) {
+    const int keyIndex = m_table->plan().primaryKey;
+    const int oldCount = m_rows.rowCount();
+    const int newCount = rows.rowCount();
+    QHash<QString, int> newRows;
+
+    // Rows loaded with different columns cannot be compared
+    if (rows.projection() != m_rows.projection()) {
+        beginResetModel();
+        m_rows = std::move(rows);
+        m_keyRowsValid = false;
+        endResetModel();
+        return;
+    }
+
+    // Index new rows by key and keep old and new rows side by side
+    newRows.reserve(newCount);
+    for (int row = 0; row < newCount; ++row)
+        newRows.insert(rows.text(row, keyIndex), row);
+    m_rows.append(rows);
+    m_rowMap.resize(oldCount);
+    std::iota(m_rowMap.begin(), m_rowMap.end(), 0);
+    m_diffing = true;
+
+    // Remove rows no longer present
+    for (int last = oldCount - 1; last >= 0; --last) {
+        if (newRows.contains(m_rows.text(last, keyIndex)))
+            continue;
+        int first = last;
+        while (first > 0 && !newRows.contains(m_rows.text(first - 1, keyIndex)))
+            --first;
+        beginRemoveRows(QModelIndex(), first, last);
+        m_rowMap.remove(first, last - first + 1);
+        endRemoveRows();
+        last = first;
+    }
+
+    // Find longest run of remaining rows already in new order
+    const int kept = m_rowMap.size();
+    QVector<int> position(kept), tails, previous(kept, -1);
+    QVector<bool> settled(kept, false);
+    for (int i = 0; i < kept; ++i) {
+        position[i] = newRows.value(m_rows.text(m_rowMap.at(i), keyIndex));
+        auto it = std::lower_bound(tails.begin(), tails.end(), i, [&](int tail, int row) { return position.at(tail) < position.at(row); });
+        if (it != tails.begin())
+            previous[i] = *(it - 1);
+        if (it == tails.end())
+            tails << i;
+        else
+            *it = i;
+    }
+    int settledCount = 0;
+    for (int i = tails.isEmpty() ? -1 : tails.last(); i >= 0; i = previous.at(i)) {
+        settled[i] = true;
+        settledCount += 1;
+    }
+
+    // Each move costs a scan of the rows, so many moves such as a flipped sort reset instead
+    if (kept - settledCount > maxDiffMoves) {
+        beginResetModel();
+        m_rows = std::move(rows);
+        m_rowMap.clear();
+        m_diffing = false;
+        m_keyRowsValid = false;
+        endResetModel();
+        return;
+    }
+
+    // Move remaining rows next to the settled rows that follow them in new order
+    QVector<int> order(kept);
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](int a, int b) { return position.at(a) < position.at(b); });
+    QVector<int> item(kept);                        // Original index of the row at each model position
+    std::iota(item.begin(), item.end(), 0);
+    for (int i : std::as_const(order)) {
+        if (settled.at(i))
+            continue;
+        const int from = item.indexOf(i);
+        int to = 0;
+        while (to < kept && !(settled.at(item.at(to)) && position.at(item.at(to)) > position.at(i)))
+            ++to;
+        if (to != from && to != from + 1) {
+            beginMoveRows(QModelIndex(), from, from, QModelIndex(), to);
+            const int storeRow = m_rowMap.at(from);
+            const int dest = to > from ? to - 1 : to;
+            m_rowMap.remove(from);
+            m_rowMap.insert(dest, storeRow);
+            item.remove(from);
+            item.insert(dest, i);
+            endMoveRows();
         }
-        m_data.append(v);
+        settled[i] = true;
     }
-    endResetModel();
-    success("successful query by", m_sortColumn);
 
+    // Insert new rows and report rows whose values changed
+    QSet<QString> oldKeys;
+    oldKeys.reserve(kept);
+    for (int storeRow : std::as_const(m_rowMap))
+        oldKeys.insert(m_rows.text(storeRow, keyIndex));
+    int changedFirst = -1;
+    for (int row = 0; row < newCount; ++row) {
+        const bool isNew = !oldKeys.contains(rows.text(row, keyIndex));
+        bool changed = false;
+        if (!isNew) {
+            const int oldRow = m_rowMap.at(row);
+            for (int column = 0; column < rows.columnCount() && !changed; ++column)
+                changed = m_rows.isNull(oldRow, column) != rows.isNull(row, column) || m_rows.text(oldRow, column) != rows.text(row, column);
+            m_rowMap[row] = oldCount + row;
+        }
+        if (changed && changedFirst < 0)
+            changedFirst = row;
+        if (!changed && changedFirst >= 0) {
+            emit dataChanged(index(changedFirst, 0), index(row - 1, columnCount() - 1));
+            changedFirst = -1;
+        }
+        if (isNew) {
+            int last = row;
+            while (last + 1 < newCount && !oldKeys.contains(rows.text(last + 1, keyIndex)))
+                ++last;
+            beginInsertRows(QModelIndex(), row, last);
+            for (int newRow = row; newRow <= last; ++newRow)
+                m_rowMap.insert(newRow, oldCount + newRow);
+            endInsertRows();
+            row = last;
+        }
+    }
+    if (changedFirst >= 0)
+        emit dataChanged(index(changedFirst, 0), index(newCount - 1, columnCount() - 1));
+
+    // Swap in the new rows, which the map now addresses in order
+    m_rows = std::move(rows);
+    m_rowMap.clear();
+    m_diffing = false;
+    m_keyRowsValid = false;
+}
+
+/**
+ * @brief Change visible columns by signalling only the differences
+ *
+ * Columns keep schema order, so removing the hidden columns and then
+ * inserting the shown ones never needs a move.
+ *
+ * @param columns New list of visible column names, in schema order
+ */
+void TableModel::applyColumns(const QStringList &columns) {
+    for (int column = m_visibleColumns.size() - 1; column >= 0; --column) {
+        if (columns.contains(m_visibleColumns.at(column)))
+            continue;
+        beginRemoveColumns(QModelIndex(), column, column);
+        m_visibleColumns.removeAt(column);
+        indexVisibleColumns();
+        endRemoveColumns();
+    }
+    for (int column = 0; column < columns.size(); ++column) {
+        if (column < m_visibleColumns.size() && m_visibleColumns.at(column) == columns.at(column))
+            continue;
+        beginInsertColumns(QModelIndex(), column, column);
+        m_visibleColumns.insert(column, columns.at(column));
+        indexVisibleColumns();
+        endInsertColumns();
+    }
+}
+
+/**
+ * @brief Find the model row of a record
+ *
+ * @param id Value of id of record to be located
+ * @returns Row of the record or -1 if not loaded or, when windowed, not resident
+ */
+int TableModel::rowOf(const QString &id) {
+    if (m_cursorOpen)
+        return m_blocks.find(m_table->plan().primaryKey, id);
+    indexKeyRows();
+    return m_keyRows.value(id, -1);
+}
+
+/**
+ * @brief Find the position of a record in the current sort order
+ *
+ * The position is computed by the database under the current filters and
+ * sort, so the record does not need to be loaded.
+ *
+ * @param id Value of id of record to be located
+ * @returns Zero based position of the record or -1 if it does not match the filters
+ */
+int TableModel::locate(const QString &id) {
+    QSqlQuery query(m_db);
+
+    // Prepare query counting the rows sorted before the record
+    const QList<FilterCondition> filters = filterConditions();
+    const QVariantMap values = m_table->filterValues(filters);
+    const QString sql = m_table->locateSql(filters, m_sortColumn, m_sortOrder);
+    query.setForwardOnly(true);
+    query.prepare(sql);
+    for (auto it = values.constBegin(); it != values.constEnd(); ++it)
+        query.bindValue(it.key(), it.value());
+    query.bindValue(":locate_key", id);
+    if (!query.exec()) {
+        qDebug() << sql;
+        fail("failed locate query:" + query.lastError().text());
+        return -1;
+    }
+    return query.next() ? query.value(0).toInt() : -1;
+}
+
+/**
+ * @brief Reload a single record and move it to its sort position
+ *
+ * Only the record is read, through the primary key and the current filters.
+ * A record that no longer matches the filters is removed, one not yet loaded
+ * is inserted, and a changed record is moved if its sort position changed.
+ * The position is found by binary search over the loaded rows. When paging,
+ * a record that sorts past the last loaded row is left for a later page; the
+ * database decides this, since it sorts text in its own collation and a
+ * record misplaced here would be read again or never read by the next page.
+ * Windowed models are refreshed instead, since the scroll cursor holds a
+ * snapshot of the result set.
+ *
+ * @param id Value of id of record to be reloaded
+ * @returns Row of the record or -1 if it is not loaded
+ */
+int TableModel::patchRow(const QString &id) {
+    RowStore rows(m_table->columns(), true, m_rows.projection());
+
+    // Fall back to reloading when rows cannot be patched in place
+    if (m_windowed || m_cursorOpen)
+        return refresh(id);
+    if (m_loading) {
+        startLoad(id);
+        return -1;
+    }
+    bool pastPage = false;
+    if (!selectRow(id, rows, pastPage))
+        return -1;
+
+    indexKeyRows();
+    const int current = m_keyRows.value(id, -1);
+    if (rows.rowCount() == 0) {
+        if (current >= 0)
+            removeRowById(id);
+        return -1;
+    }
+
+    // Leave rows that belong to a page not yet loaded
+    if (pastPage) {
+        if (current >= 0)
+            removeRowById(id);
+        return -1;
+    }
+    const int target = insertPosition(rows, 0, current);
+
+    if (current < 0) {
+        beginInsertRows(QModelIndex(), target, target);
+        m_rows.insert(target, rows, 0);
+        endInsertRows();
+        reindexKeyRows(target, m_rows.rowCount() - 1);
+    } else if (current == target) {
+        m_rows.replace(current, rows, 0);
+        emit dataChanged(index(current, 0), index(current, columnCount() - 1));
+    } else {
+        beginMoveRows(QModelIndex(), current, current, QModelIndex(), target > current ? target + 1 : target);
+        m_rows.remove(current);
+        m_rows.insert(target, rows, 0);
+        endMoveRows();
+        emit dataChanged(index(target, 0), index(target, columnCount() - 1));
+        reindexKeyRows(qMin(current, target), qMax(current, target));
+    }
+    success("patched ID:", id);
+    return target;
+}
+
+/**
+ * @brief Load a single new record into its sort position
+ *
+ * @param id Value of id of record to be loaded
+ * @returns Row of the record or -1 if it is not loaded
+ */
+int TableModel::insertRow(const QString &id) {
+    return patchRow(id);
+}
+
+/**
+ * @brief Remove a single record from the model
+ *
+ * The database is not changed.
+ *
+ * @param id Value of id of record to be removed
+ * @returns True if the record was loaded, otherwise false
+ */
+bool TableModel::removeRowById(const QString &id) {
+    if (m_windowed || m_cursorOpen) {
+        refresh("");
+        return true;
+    }
+    indexKeyRows();
+    const int row = m_keyRows.value(id, -1);
+    if (row < 0)
+        return false;
+
+    beginRemoveRows(QModelIndex(), row, row);
+    m_rows.remove(row);
+    endRemoveRows();
+    m_keyRows.remove(id);
+    reindexKeyRows(row, m_rows.rowCount() - 1);
+    return true;
+}
+
+/**
+ * @brief Reload a set of records
+ *
+ * Each record is patched in place. A large set, such as the result of a
+ * bulk import, refreshes the model instead since one query is then cheaper
+ * than a query per record.
+ *
+ * @param ids Values of ids of records to be reloaded
+ */
+void TableModel::patchRows(const QStringList &ids) {
+    const int patchLimit = 50;
+    if (ids.size() > patchLimit || m_windowed || m_cursorOpen) {
+        refresh("");
+        return;
+    }
+    for (const QString &id : ids)
+        patchRow(id);
+}
+
+/**
+ * @brief Keep the model in step with changes made through a table access object
+ *
+ * Single-row changes are patched in place and batch changes refresh the model.
+ *
+ * @param access Table access object for the same table
+ */
+void TableModel::watch(TableAccess *access) {
+    connect(access, &TableAccess::rowAdded, this, [this](const QString &id) { insertRow(id); });
+    connect(access, &TableAccess::rowUpdated, this, [this](const QString &id) { patchRow(id); });
+    connect(access, &TableAccess::rowRemoved, this, [this](const QString &id) { removeRowById(id); });
+    connect(access, &TableAccess::rowsChanged, this, [this]() { refresh(""); });
+}
+
+/**
+ * @brief Keep the model in step with changes made by other connections
+ *
+ * @param manager Database manager delivering change notifications
+ */
+void TableModel::watch(DatabaseManager *manager) {
+    connect(manager, &DatabaseManager::rowsNotified, this, [this](const QString &tableName, const QStringList &ids) {
+        if (tableName == m_table->tableName())
+            patchRows(ids);
+    });
+}
+
+/**
+ * @brief Read a single record matching the current filters
+ *
+ * @param id Value of id of record to be read
+ * @param rows Store to which the record is appended, if it matches
+ * @param pastPage Returns true if more pages are to be read and the record sorts after the last loaded row
+ * @returns True if successful, otherwise false
+ */
+bool TableModel::selectRow(const QString &id, RowStore &rows, bool &pastPage) {
+    const SchemaPlan &plan = m_table->plan();
+    const KeysetCursor after = m_pageSize > 0 && !m_atEnd ? m_cursor : KeysetCursor();
+    QSqlQuery query(m_db);
+
+    // Prepare query on the primary key, positioned against the last loaded row
+    QList<FilterCondition> filters = filterConditions();
+    filters << FilterCondition { plan.aliases.at(plan.primaryKey), FilterOperator::Equals, id };
+    const QVariantMap values = m_table->filterValues(filters);
+    const QString sql = m_table->selectPastSql(filters, m_sortColumn, m_sortOrder, after, true, rows.projection());
+    query.setForwardOnly(true);
+    query.prepare(sql);
+    for (auto it = values.constBegin(); it != values.constEnd(); ++it)
+        query.bindValue(it.key(), it.value());
+    if (after.isValid) {
+        if (!after.sortValue.isNull())
+            query.bindValue(":after_sort", after.sortValue);
+        query.bindValue(":after_key", after.key);
+    }
+    if (!query.exec()) {
+        qDebug() << sql;
+        return fail("failed row query:" + query.lastError().text());
+    }
+    pastPage = false;
+    if (query.next()) {
+        rows.append(query);
+        pastPage = query.value(query.record().count() - 1).toBool() || (m_pageSize > 0 && !m_atEnd && !after.isValid);
+    }
+    return true;
+}
+
+/**
+ * @brief Get the columns to be loaded
+ *
+ * Only the visible columns, the primary key and the sort column are loaded.
+ * When diffing, columns already loaded stay loaded so that new rows can be
+ * compared with the loaded rows.
+ *
+ * @returns Column indexes in ascending order
+ */
+QList<int> TableModel::projection() const {
+    QList<int> columns;
+    for (int index : m_visibleIndexes)
+        columns << index;
+    columns << m_table->plan().primaryKey << m_table->ordinal(m_sortColumn, true);
+    if (m_diffRefresh && m_rows.rowCount() > 0)
+        columns << m_rows.projection();
+
+    columns.removeAll(-1);
+    std::sort(columns.begin(), columns.end());
+    columns.erase(std::unique(columns.begin(), columns.end()), columns.end());
+    return columns;
+}
+
+/**
+ * @brief Read the current watermark of the table
+ *
+ * @param watermark Returns the watermark
+ * @returns True if successful, otherwise false
+ */
+bool TableModel::readWatermark(qint64 &watermark) {
+    QSqlQuery query(m_db);
+    const QString sql = m_table->watermarkSql();
+    query.setForwardOnly(true);
+    if (!query.exec(sql) || !query.next()) {
+        qDebug() << sql;
+        return fail("failed watermark query:" + query.lastError().text());
+    }
+    watermark = query.value(0).toLongLong();
+    return true;
+}
+
+/**
+ * @brief Load columns that were left out of the loaded rows
+ *
+ * The columns are read for the loaded rows by primary key in batches.
+ *
+ * @param columns Indexes of columns to be loaded
+ * @returns True if successful, otherwise false
+ */
+bool TableModel::fillColumns(const QList<int> &columns) {
+    const SchemaPlan &plan = m_table->plan();
+    const int batchSize = 1000;
+    const int count = m_rows.rowCount();
+    QList<int> projection = columns;
+    QVector<QVariantList> values(columns.size(), QVariantList(count));
+
+    // Select the missing columns along with the primary key
+    projection << plan.primaryKey;
+    std::sort(projection.begin(), projection.end());
+    const int keyPosition = projection.indexOf(plan.primaryKey);
+    indexKeyRows();
+
+    for (int first = 0; first < count; first += batchSize) {
+        QVariantList keys;
+        for (int row = first; row < qMin(count, first + batchSize); ++row)
+            keys << m_rows.text(row, plan.primaryKey);
+
+        // Read batch of rows by primary key
+        const QList<FilterCondition> filters = { { plan.aliases.at(plan.primaryKey), FilterOperator::In, keys } };
+        const QVariantMap bound = m_table->filterValues(filters);
+        const QString sql = m_table->selectSql(filters, true, projection);
+        QSqlQuery query(m_db);
+        query.setForwardOnly(true);
+        query.prepare(sql);
+        for (auto it = bound.constBegin(); it != bound.constEnd(); ++it)
+            query.bindValue(it.key(), it.value());
+        if (!query.exec()) {
+            qDebug() << sql;
+            return fail("failed column query:" + query.lastError().text());
+        }
+        while (query.next()) {
+            const int row = m_keyRows.value(query.value(keyPosition).toString(), -1);
+            if (row < 0)
+                continue;
+            for (int i = 0; i < columns.size(); ++i)
+                values[i][row] = query.value(projection.indexOf(columns.at(i)));
+        }
+    }
+
+    // Store the columns
+    for (int i = 0; i < columns.size(); ++i)
+        m_rows.fill(columns.at(i), values.at(i));
+    m_projection = m_rows.projection();
+    return true;
+}
+
+/**
+ * @brief Find the sort position of a row among the loaded rows
+ *
+ * @param rows Store holding the row
+ * @param row Row index in the store
+ * @param skip Loaded row to be ignored, such as the row's own old position, or -1
+ * @returns Row index at which the row belongs once the skipped row is removed
+ */
+int TableModel::insertPosition(const RowStore &rows, int row, int skip) const {
+    int low = 0;
+    int high = m_rows.rowCount() - (skip >= 0 ? 1 : 0);
+
+    while (low < high) {
+        const int middle = (low + high) / 2;
+        const int loaded = skip >= 0 && middle >= skip ? middle + 1 : middle;
+        if (compareRows(m_rows, loaded, rows, row) <= 0)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    return low;
+}
+
+/**
+ * @brief Compare two rows in the current sort order
+ *
+ * This matches the ordering of the paged select: the sort column with
+ * nulls last when ascending and first when descending, then the primary key.
+ *
+ * @param rows Store holding the first row
+ * @param row Row index in the first store
+ * @param other Store holding the second row
+ * @param otherRow Row index in the second store
+ * @returns Negative, zero or positive as the first row sorts before, with or after the second
+ */
+int TableModel::compareRows(const RowStore &rows, int row, const RowStore &other, int otherRow) const {
+    const int sortIndex = m_table->ordinal(m_sortColumn, true);
+    int result = rows.compare(row, sortIndex, other, otherRow);
+    if (result == 0)
+        result = rows.compare(row, m_table->plan().primaryKey, other, otherRow);
+    return m_sortOrder == Qt::AscendingOrder ? result : -result;
+}
+
+/**
+ * @brief Rebuild the primary key index if the loaded rows were replaced
+ */
+void TableModel::indexKeyRows() {
+    if (m_keyRowsValid)
+        return;
+    m_keyRows.clear();
+    m_keyRows.reserve(m_rows.rowCount());
+    m_keyRowsValid = true;
+    reindexKeyRows(0, m_rows.rowCount() - 1);
+}
+
+/**
+ * @brief Update the primary key index for a range of rows that shifted
+ *
+ * @param first First row
+ * @param last Last row
+ */
+void TableModel::reindexKeyRows(int first, int last) {
+    const int keyIndex = m_table->plan().primaryKey;
+    if (!m_keyRowsValid)
+        return;
+    for (int row = first; row <= last; ++row)
+        m_keyRows.insert(m_rows.text(row, keyIndex), row);
+}
+
+/**
+ * @brief Queue a background load using the current properties
+ *
+ * @param id Value of id of record to be located
+ */
+void TableModel::startLoad(const QString &id) {
+    ModelLoader::Request request;
+    request.table = m_table;
+    request.filters = filterConditions();
+    request.sortColumn = m_sortColumn;
+    request.sortOrder = m_sortOrder;
+    request.pageSize = m_pageSize;
+    request.id = id;
+    request.projection = projection();
+    request.readWatermark = m_table->rowVersioning();
+    if (m_windowed) {
+        const QList<FilterCondition> filters = filterConditions();
+        request.windowed = true;
+        request.cursorName = m_cursorName;
+        request.cursorSql = inlineFilterValues(m_table->selectSql(filters, m_sortColumn, m_sortOrder, true, request.projection), filters);
+        request.blockSize = m_pageSize > 0 ? m_pageSize : 200;
+    }
+    m_loader->submit(request);
+    if (!m_loading) {
+        m_loading = true;
+        emit loadingChanged();
+    }
+}
+
+/**
+ * @brief Replace the model rows with the result of a background load
+ *
+ * A windowed result resets the model to the row count of the window with
+ * only the block read by the loader resident.
+ *
+ * @param result Rows produced by the loader
+ */
+void TableModel::finishLoad(ModelLoader::Result &result) {
+    const bool window = result.block >= 0 && result.error.isEmpty();
+    if (result.error.isEmpty())
+        m_projection = result.rows.projection();
+    if (m_diffRefresh && !m_cursorOpen && !window) {
+        // Keep the current rows when the load failed
+        if (result.error.isEmpty())
+            applyRows(result.rows);
+    } else if (window) {
+        beginResetModel();
+        closeWindow();
+        m_rows = RowStore(m_table->columns(), true, m_projection);
+        m_cursorOpen = true;
+        m_rowCount = result.rowCount;
+        m_lastBlock = result.block;
+        m_blocks.setBlockSize(result.blockSize);
+        if (result.rowCount > 0)
+            m_blocks.insert(result.block, result.rows);
+        endResetModel();
+    } else {
+        beginResetModel();
+        closeWindow();
+        m_rows = std::move(result.rows);
+        endResetModel();
+    }
+    m_keyRowsValid = false;
+    m_cursor = result.cursor;
+    m_atEnd = result.atEnd;
+    if (result.error.isEmpty() && result.watermark >= 0) {
+        m_watermark = result.watermark;
+        m_watermarkAge.start();
+    }
+
+    m_loading = false;
+    emit loadingChanged();
+    if (result.error.isEmpty())
+        success("successful query by", m_sortColumn);
+    else
+        fail(result.error);
+    emit loaded(result.foundIdx);
+}
+
+/**
+ * @brief Load the page of rows following the current cursor
+ *
+ * The loaded rows are appended to the model and the cursor is moved
+ * to the last row read. A short page marks the end of the result set.
+ *
+ * @param id Value of id of record to be located
+ * @param limit Number of rows to read, 0 for the page size
+ * @returns Index to found record or -1 if not found
+ */
+int TableModel::fetchPage(const QString &id, int limit) {
+    const int keyIndex = m_table->plan().primaryKey;
+    const int sortIndex = m_table->ordinal(m_sortColumn, true);
+    RowStore rows(m_table->columns(), true, m_projection);
+    QSqlQuery query(m_db);
+    int foundIdx = -1;
+
+    // Prepare query positioned after the last loaded row
+    const QList<FilterCondition> filters = filterConditions();
+    const QVariantMap values = m_table->filterValues(filters);
+    if (limit <= 0)
+        limit = m_pageSize;
+    const QString sql = m_table->selectSql(filters, m_sortColumn, m_sortOrder, m_cursor, limit, true, m_projection);
+    query.setForwardOnly(true);
+    query.prepare(sql);
+    for (auto it = values.constBegin(); it != values.constEnd(); ++it)
+        query.bindValue(it.key(), it.value());
+    if (m_cursor.isValid) {
+        if (!m_cursor.sortValue.isNull())
+            query.bindValue(":after_sort", m_cursor.sortValue);
+        query.bindValue(":after_key", m_cursor.key);
+    }
+    if (!query.exec()) {
+        qDebug() << sql;
+        m_atEnd = true;
+        fail("failed page query:" + query.lastError().text());
+        return foundIdx;
+    }
+
+    // Save page and remember where it ended
+    rows.reserve(m_pageSize);
+    while (query.next()) {
+        rows.append(query);
+        if (foundIdx < 0 && !id.isEmpty() && rows.text(rows.rowCount() - 1, keyIndex) == id)
+            foundIdx = m_rows.rowCount() + rows.rowCount() - 1;
+        m_cursor = { m_table->sortValue(m_sortColumn, rows.value(rows.rowCount() - 1, sortIndex)), rows.value(rows.rowCount() - 1, keyIndex), true };
+    }
+    m_atEnd = rows.rowCount() < limit;
+
+    // Append page to model
+    if (rows.rowCount() > 0) {
+        m_keyRowsValid = false;
+        beginInsertRows(QModelIndex(), m_rows.rowCount(), m_rows.rowCount() + rows.rowCount() - 1);
+        m_rows.append(rows);
+        endInsertRows();
+    }
     return foundIdx;
 }
 
+/**
+ * @brief Locate the stored row values for a model row
+ *
+ * When windowed, a block that is not resident is requested from the loader
+ * along with the next block in the direction of scrolling, and the row reads
+ * as empty until dataChanged reports the block has arrived.
+ *
+ * @param row Row number
+ * @param offset Returns the row number within the returned store
+ * @returns Pointer to the store holding the row or nullptr if the row is not resident
+ */
+const RowStore *TableModel::rowAt(int row, int &offset) const {
+    offset = m_diffing ? m_rowMap.at(row) : row;
+    if (!m_cursorOpen)
+        return &m_rows;
+
+    // Request block and predict scroll direction from the last block read
+    const int block = m_blocks.blockOf(row);
+    requestBlock(block);
+    if (block != m_lastBlock) {
+        requestBlock((m_lastBlock < 0 || block > m_lastBlock) ? block + 1 : block - 1);
+        m_lastBlock = block;
+    }
+    if (!m_blocks.contains(block))
+        return nullptr;
+    offset = row - block * m_blocks.blockSize();
+    const RowStore *rows = m_blocks.block(block);
+    return rows && offset < rows->rowCount() ? rows : nullptr;
+}
+
+/**
+ * @brief Discard the resident blocks of the window
+ *
+ * The scroll cursor itself is closed by the loader on its own connection
+ * when the next load starts.
+ */
+void TableModel::closeWindow() {
+    m_cursorOpen = false;
+    m_rowCount = 0;
+    m_lastBlock = -1;
+    m_blocks.clear();
+    m_requestedBlocks.clear();
+}
+
+/**
+ * @brief Ask the loader for a block of the window
+ *
+ * Blocks outside the window, already resident or already requested are
+ * not requested again.
+ *
+ * @param block Block number
+ */
+void TableModel::requestBlock(int block) const {
+    if (!m_cursorOpen || !m_loader || block < 0 || block * m_blocks.blockSize() >= m_rowCount)
+        return;
+    if (m_blocks.contains(block) || m_requestedBlocks.contains(block))
+        return;
+    m_requestedBlocks.insert(block);
+    m_loader->fetchBlock(block);
+}
+
+/**
+ * @brief Add a block read by the loader to the window
+ *
+ * The rows of the block are reported as changed so that views read them.
+ *
+ * @param block Block read by the loader
+ */
+void TableModel::finishBlock(ModelLoader::Block &block) {
+    m_requestedBlocks.remove(block.block);
+    if (!m_cursorOpen)
+        return;
+    if (!block.error.isEmpty()) {
+        fail(block.error);
+        return;
+    }
+
+    const int first = block.block * m_blocks.blockSize();
+    const int last = qMin(first + block.rows.rowCount(), m_rowCount) - 1;
+    m_blocks.insert(block.block, block.rows);
+    if (last >= first)
+        emit dataChanged(index(first, 0), index(last, columnCount() - 1));
+}
+
+/**
+ * @brief Refresh the model once filter changes have settled
+ *
+ * The filters are saved and the current record is located again if it
+ * still matches.
+ */
+void TableModel::applyFilters() {
+    m_state->save("filters", m_filters);
+    refresh("");
+}
+
+/**
+ * @brief Find the data index of a filtered column
+ *
+ * @param column Column alias or label alias
+ * @returns Data column index or -1
+ */
+int TableModel::filterColumnIndex(const QString &column) const {
+    const int index = m_table->ordinal(column, true);
+    return index >= 0 ? index : m_table->ordinal(column);
+}
+
+/**
+ * @brief Convert a filter on the labels of an enumerated column
+ *
+ * Enumerated columns hold integers and are labeled on the client, so label
+ * text never matches in Sql. A like filter, or an equals filter holding text,
+ * becomes an in filter over the values whose labels match.
+ *
+ * @param index Data index of the filtered column
+ * @param condition Filter condition on the column
+ * @returns Filter condition to be applied to the select
+ */
+FilterCondition TableModel::labelCondition(int index, const FilterCondition &condition) const {
+    const std::shared_ptr<const EnumLabels> labels = m_table->plan().enumLabels.value(index);
+    if (!labels)
+        return condition;
+
+    bool isNumber = false;
+    condition.value.toString().toLongLong(&isNumber);
+    if (condition.op == FilterOperator::Like)
+        return FilterCondition { condition.columnName, FilterOperator::In, labels->valuesLike(condition.value.toString()) };
+    if (condition.op == FilterOperator::Equals && !isNumber)
+        return FilterCondition { condition.columnName, FilterOperator::In, labels->valuesLabeled(condition.value.toString()) };
+    return condition;
+}
+
+/**
+ * @brief Convert column filters to filter conditions
+ *
+ * Label aliases are mapped to their underlying column, filters on labels
+ * become filters on values and a between filter becomes a pair of bounds.
+ *
+ * @returns Filter conditions to be applied to the select
+ */
+QList<FilterCondition> TableModel::filterConditions() const {
+    const SchemaPlan &plan = m_table->plan();
+    QList<FilterCondition> conditions;
+
+    for (const QVariant &filter : m_filters) {
+        const QVariantMap map = filter.toMap();
+        const int index = filterColumnIndex(map.value("column").toString());
+        const QString op = map.value("op").toString();
+        const QVariant value = map.value("value");
+        if (index < 0)
+            continue;
+
+        const QString &column = plan.aliases.at(index);
+        if (op == "between") {
+            const QVariantList bounds = value.toList();
+            if (bounds.size() > 0 && !bounds.at(0).isNull())
+                conditions << FilterCondition { column, FilterOperator::GreaterThanOrEqual, bounds.at(0) };
+            if (bounds.size() > 1 && !bounds.at(1).isNull())
+                conditions << FilterCondition { column, FilterOperator::LessThanOrEqual, bounds.at(1) };
+        } else if (filterOperators.contains(op))
+            conditions << labelCondition(index, FilterCondition { column, filterOperators.value(op), value });
+    }
+    return conditions;
+}
+
+/**
+ * @brief Replace filter placeholders with literal values
+ *
+ * Values are formatted by the driver so that they are escaped the same
+ * way bound values would be. The statement is scanned once and each
+ * placeholder replaced where it stands, so text inlined from one value is
+ * never scanned again for placeholders.
+ *
+ * @param sql Sql statement containing filter placeholders
+ * @param filters Filter conditions used to generate the statement
+ * @returns Sql statement with values inlined
+ */
+QString TableModel::inlineFilterValues(const QString &sql, const QList<FilterCondition> &filters) const {
+    static const QRegularExpression placeholder(":filter_\\d+\\b");
+    const QVariantMap values = m_table->filterValues(filters);
+    QString result;
+    qsizetype last = 0;
+
+    result.reserve(sql.size());
+    for (QRegularExpressionMatchIterator it = placeholder.globalMatch(sql); it.hasNext();) {
+        const QRegularExpressionMatch match = it.next();
+        const auto value = values.constFind(match.captured());
+        if (value == values.constEnd())
+            continue;
+
+        QSqlField field(QString(), value.value().metaType());
+        field.setValue(value.value());
+        result += QStringView(sql).mid(last, match.capturedStart() - last);
+        result += m_db.driver()->formatValue(field);
+        last = match.capturedEnd();
+    }
+    result += QStringView(sql).mid(last);
+    return result;
+}
+
 /**
  * @brief Convert column index to data index
  *
@@ -305,9 +1757,18 @@ int TableModel::refresh(const QString &id) {
  * @returns Data column index or -1
  */
 int TableModel::columnToIndex(const int column) const {
-    if (column < m_visibleColumns.size()) {
-        QString columnName = m_visibleColumns.at(column);
-        return m_table->columnAliases(true, true).indexOf(columnName);
-    }
-    return -1;
+    return column < m_visibleIndexes.size() ? m_visibleIndexes.at(column) : -1;
+}
+
+/**
+ * @brief Rebuild data indexes of the visible columns
+ *
+ * This is called whenever the visible column list changes so that
+ * data lookups do not have to search for column names.
+ */
+void TableModel::indexVisibleColumns() {
+    m_visibleIndexes.clear();
+    m_visibleIndexes.reserve(m_visibleColumns.size());
+    for (const QString &name : std::as_const(m_visibleColumns))
+        m_visibleIndexes << m_table->ordinal(name, true);
 }
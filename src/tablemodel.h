@@ -4,10 +4,18 @@
 #include <QObject>
 #include <QSqlDatabase>
 #include <QAbstractTableModel>
+#include <QElapsedTimer>
+#include <QSet>
+#include <QTimer>
 #include <QtQml/qqmlregistration.h>
+#include "base/modelloader.h"
+#include "base/rowblockcache.h"
 #include "base/tablemixin.h"
 #include "state.h"
 
+// Forward declarations
+class DatabaseManager;
+
 enum TableRoles {                                   // Used to setup custom roles if the built-in roles are inadequate
     CellDataRole = Qt::UserRole + 1,
     CellNameRole,
@@ -28,6 +36,15 @@ class TableModel : public QAbstractTableModel, public TableMixin<TableModel>
     Q_PROPERTY(QStringList columnTitles READ columnTitles CONSTANT)
     Q_PROPERTY(QStringList columnTypes READ columnTypes CONSTANT)
     Q_PROPERTY(QStringList visibleColumns READ visibleColumns WRITE setVisibleColumns NOTIFY visibleColumnsChanged)
+    Q_PROPERTY(int pageSize READ pageSize WRITE setPageSize NOTIFY pageSizeChanged)
+    Q_PROPERTY(bool windowed READ windowed WRITE setWindowed NOTIFY windowedChanged)
+    Q_PROPERTY(int blockBudget READ blockBudget WRITE setBlockBudget NOTIFY blockBudgetChanged)
+    Q_PROPERTY(bool async READ async WRITE setAsync NOTIFY asyncChanged)
+    Q_PROPERTY(bool loading READ loading NOTIFY loadingChanged)
+    Q_PROPERTY(QVariantList filters READ filters WRITE setFilters NOTIFY filtersChanged)
+    Q_PROPERTY(bool diffRefresh READ diffRefresh WRITE setDiffRefresh NOTIFY diffRefreshChanged)
+    Q_PROPERTY(int pollInterval READ pollInterval WRITE setPollInterval NOTIFY pollIntervalChanged)
+    Q_PROPERTY(int clientSortLimit READ clientSortLimit WRITE setClientSortLimit NOTIFY clientSortLimitChanged)
 
 public:
     explicit TableModel(QSqlDatabase db, DatabaseTables *tables, QString tableName, QObject *parent = nullptr);
@@ -36,16 +53,48 @@ public:
     QHash<int, QByteArray> roleNames() const override;
     int columnCount(const QModelIndex & = QModelIndex()) const override;
     int rowCount(const QModelIndex & = QModelIndex()) const override;
+    bool canFetchMore(const QModelIndex &parent) const override;
+    void fetchMore(const QModelIndex &parent) override;
     Qt::SortOrder sortOrder();
     QString sortColumn();
     QStringList columnNames() const;
     QStringList columnTitles() const;
     QStringList columnTypes() const;
     QStringList visibleColumns() const;
+    int pageSize() const;
+    bool windowed() const;
+    int blockBudget() const;
+    bool async() const;
+    bool loading() const;
+    QVariantList filters() const;
+    bool diffRefresh() const;
+    int pollInterval() const;
+    int clientSortLimit() const;
 
+    void setPageSize(int pageSize);
+    void setWindowed(bool windowed);
+    void setBlockBudget(int blockBudget);
+    void setAsync(bool async);
+    void setDiffRefresh(bool diffRefresh);
+    void setPollInterval(int pollInterval);
+    void setClientSortLimit(int clientSortLimit);
     Q_INVOKABLE void setVisibleColumns(const QStringList &columns);
+    Q_INVOKABLE void setFilters(const QVariantList &filters);
+    Q_INVOKABLE void setFilter(const QString &column, const QString &op, const QVariant &value = QVariant());
+    Q_INVOKABLE void removeFilter(const QString &column);
+    Q_INVOKABLE void clearFilters();
     Q_INVOKABLE int sortBy(const QString sortColumn, const QString &id);
     Q_INVOKABLE int refresh(const QString &id);
+    Q_INVOKABLE int refreshChanges();
+    Q_INVOKABLE int rowOf(const QString &id);
+    Q_INVOKABLE int locate(const QString &id);
+    Q_INVOKABLE int patchRow(const QString &id);
+    Q_INVOKABLE int insertRow(const QString &id);
+    Q_INVOKABLE bool removeRowById(const QString &id);
+    Q_INVOKABLE void patchRows(const QStringList &ids);
+    using QAbstractTableModel::insertRow;
+    void watch(TableAccess *access);
+    void watch(DatabaseManager *manager);
 
     // Expose signal emitters for the mixin
     void emitSuccess(const QString &message, const QString &id) {
@@ -59,17 +108,77 @@ signals:
     void sortOrderChanged();
     void sortColumnChanged();
     void visibleColumnsChanged();
+    void pageSizeChanged();
+    void windowedChanged();
+    void blockBudgetChanged();
+    void asyncChanged();
+    void loadingChanged();
+    void loaded(int foundIdx);
+    void filtersChanged();
+    void diffRefreshChanged();
+    void pollIntervalChanged();
+    void clientSortLimitChanged();
     void operationSuccess(const QString &message, const QString &id);
     void operationFailed(const QString &error);
 
 protected:
     int columnToIndex(const int column) const;
+    void indexVisibleColumns();
+    int fetchPage(const QString &id, int limit = 0);
+    bool selectRows(RowStore &rows, const QString &id, int &foundIdx);
+    bool sortRows(const QString &previousColumn, Qt::SortOrder previousOrder);
+    void applyRows(RowStore &rows);
+    void applyColumns(const QStringList &columns);
+    bool selectRow(const QString &id, RowStore &rows, bool &pastPage);
+    QList<int> projection() const;
+    bool readWatermark(qint64 &watermark);
+    bool fillColumns(const QList<int> &columns);
+    int insertPosition(const RowStore &rows, int row, int skip) const;
+    int compareRows(const RowStore &rows, int row, const RowStore &other, int otherRow) const;
+    void indexKeyRows();
+    void reindexKeyRows(int first, int last);
+    const RowStore *rowAt(int row, int &offset) const;
+    void closeWindow();
+    void requestBlock(int block) const;
+    void startLoad(const QString &id);
+    void finishLoad(ModelLoader::Result &result);
+    void finishBlock(ModelLoader::Block &block);
+    void applyFilters();
+    int filterColumnIndex(const QString &column) const;
+    QList<FilterCondition> filterConditions() const;
+    FilterCondition labelCondition(int index, const FilterCondition &condition) const;
+    QString inlineFilterValues(const QString &sql, const QList<FilterCondition> &filters) const;
 
     Qt::SortOrder m_sortOrder;                      // Current sort order (Ascending / Descending)
     QString m_sortColumn;                           // Current sort column
     QStringList m_visibleColumns;                   // List of visible column names
-    QVector<QVector<QString>> m_data;               // Vector of vectors of data to be displayed
+    QVector<int> m_visibleIndexes;                  // Data index of each visible column
+    RowStore m_rows;                                // Loaded rows held by column
     State *m_state;                                 // Persistant state information
+    int m_pageSize = 0;                             // Rows per page, 0 to load the whole table
+    KeysetCursor m_cursor;                          // Position of last loaded row when paging
+    bool m_atEnd = true;                            // True when all pages have been loaded
+    bool m_windowed = false;                        // True to keep only a window of blocks around the viewport
+    bool m_cursorOpen = false;                      // True while the server-side scroll cursor is declared
+    QString m_cursorName;                           // Name of server-side scroll cursor
+    int m_rowCount = 0;                             // Total rows in result set when windowed
+    mutable int m_lastBlock = -1;                   // Last block read, used to predict scroll direction
+    mutable RowBlockCache m_blocks;                 // Resident row blocks when windowed
+    mutable QSet<int> m_requestedBlocks;            // Blocks requested from the loader and not yet delivered
+    ModelLoader *m_loader = nullptr;                // Background loader, only set when loading asynchronously
+    bool m_loading = false;                         // True while a background load is outstanding
+    QVariantList m_filters;                         // Column filters, each a map of column, op and value
+    QTimer m_filterTimer;                           // Debounces filter changes into a single refresh
+    bool m_diffRefresh = false;                     // True to apply refreshes as row and column differences
+    bool m_diffing = false;                         // True while rows are addressed through the row map
+    QVector<int> m_rowMap;                          // Stored row of each model row while diffing
+    QList<int> m_projection;                        // Indexes of columns loaded: visible columns, primary key and sort column
+    QHash<QString, int> m_keyRows;                  // Model row of each primary key
+    bool m_keyRowsValid = false;                    // False when the key index needs to be rebuilt
+    qint64 m_watermark = -1;                        // Watermark taken before the rows were loaded, -1 if unknown
+    QElapsedTimer m_watermarkAge;                   // Time since the watermark was taken
+    QTimer m_pollTimer;                             // Polls for rows changed since the watermark
+    int m_clientSortLimit = 100000;                 // Most resident rows sorted in memory, 0 to always sort in the database
 };
 
 #endif // TABLEMODEL_H
@@ -17,4 +17,10 @@ CategoryTable::CategoryTable(QObject *parent) : TableSchema ("Categories", "cat"
     addColumn({"name",              tr("Category"),         ColumnType::String,     "TEXT",             false,  false,  false,  ""});
     addColumn({"description",       tr("Description"),      ColumnType::String,     "TEXT",             false,  false,  false,  ""});
     addColumn({"type",              tr("Type"),             ColumnType::Int,        "SMALLINT",         false,  false,  false,  "", nullptr, std::make_shared<EnumConstraint>(TypeConstraint)});
+
+    // Notify other instances of changed rows and version rows for delta refresh
+    setNotifyChanges(true);
+    setRowVersioning(true);
+    // Index the columns rows can be sorted on
+    setSortIndexes(true);
 }
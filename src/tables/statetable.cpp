@@ -12,4 +12,11 @@ StateTable::StateTable(QObject *parent) : TableSchema ("States", "sta", parent)
     addColumn({"object",            tr("Object"),           ColumnType::String,     "TEXT",             false,  false,  false,  ""});
     addColumn({"property_name",     tr("Property\nName"),   ColumnType::String,     "TEXT",             false,  false,  false,  ""});
     addColumn({"property_value",    tr("Property\nValue"),  ColumnType::String,     "TEXT",             false,  false,  false,  ""});
+    // Keys
+    addUniqueKey({"object", "property_name"});
+    // Replaced by the unique key
+    dropIndex("idx_states_object_property_name");
+
+    // Notify other sessions' state caches of changed rows
+    setNotifyChanges(true);
 }
@@ -16,7 +16,13 @@ VendorTable::VendorTable(QObject *parent) : TableSchema ("Vendors", "ven", paren
     addColumn({"city",              tr("City"),             ColumnType::String,     "TEXT",             false,  false,  false,  ""});
     addColumn({"state",             tr("State"),            ColumnType::String,     "TEXT",             false,  false,  false,  ""});
     addColumn({"postal_code",       tr("Post code"),        ColumnType::String,     "TEXT",             false,  false,  false,  ""});
-    addColumn({"phone",             tr("Phone\nnumber"),    ColumnType::String,     "TEXT",             false,  false,  false,  ""});
+    addColumn({"phone",             tr("Phone\nnumber"),    ColumnType::String,     "TEXT",             false,  false,  false,  "", nullptr, std::make_shared<RegexConstraint>(R"([0-9+()\-. ]*)", tr("may only hold digits, spaces and + ( ) - ."))});
     // Foreign keys
     addForeignKey({"category_id",   "categories",       "id",   "cat",      ReferentialAction::Restrict,    ReferentialAction::Cascade});
+
+    // Notify other instances of changed rows and version rows for delta refresh
+    setNotifyChanges(true);
+    setRowVersioning(true);
+    // Index the columns rows can be sorted on
+    setSortIndexes(true);
 }
@@ -0,0 +1,104 @@
+#include <QSqlDatabase>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QThread>
+#include <QtTest>
+#include "base/connectionpool.h"
+
+/**
+ * @brief Connection pool tests
+ *
+ * Run against the PostgreSQL database named by the PFINANCE_TEST_DBNAME,
+ * PFINANCE_TEST_HOST, PFINANCE_TEST_PORT, PFINANCE_TEST_USERNAME and
+ * PFINANCE_TEST_PASSWORD environment variables. Skipped when no database is named.
+ */
+class TestConnectionPool : public QObject
+{
+    Q_OBJECT
+    std::shared_ptr<ConnectionPool> m_pool;         // Pool under test
+    QList<QThread *> m_threads;                     // Worker threads leasing connections
+    QList<QObject *> m_workers;                     // Context for work run on each worker thread
+
+private slots:
+    void initTestCase();
+    void leasesFromMoreThreadsThanPoolMax();
+    void cleanupTestCase();
+};
+
+/**
+ * @brief Connect to the test database and pool its connection
+ */
+void TestConnectionPool::initTestCase() {
+    const QString dbname = qEnvironmentVariable("PFINANCE_TEST_DBNAME");
+    if (dbname.isEmpty())
+        QSKIP("PFINANCE_TEST_DBNAME is not set");
+
+    QSqlDatabase db = QSqlDatabase::addDatabase("QPSQL");
+    db.setHostName(qEnvironmentVariable("PFINANCE_TEST_HOST", "localhost"));
+    db.setPort(qEnvironmentVariableIntValue("PFINANCE_TEST_PORT") ? qEnvironmentVariableIntValue("PFINANCE_TEST_PORT") : 5432);
+    db.setDatabaseName(dbname);
+    db.setUserName(qEnvironmentVariable("PFINANCE_TEST_USERNAME"));
+    db.setPassword(qEnvironmentVariable("PFINANCE_TEST_PASSWORD"));
+    QVERIFY2(db.open(), qPrintable(db.lastError().text()));
+
+    // The source connection and two pooled connections
+    m_pool = ConnectionPool::create(db, 1, 3, 60000);
+}
+
+/**
+ * @brief Threads that keep running after their work still let later threads lease
+ *
+ * Each thread leases a connection, queries, returns the lease and stays idle,
+ * as the model loaders and the state cache worker do. Threads past the pool
+ * maximum only get a connection once an idle thread has closed its own.
+ */
+void TestConnectionPool::leasesFromMoreThreadsThanPoolMax() {
+    constexpr int threadCount = 5;
+
+    for (int i = 0; i < threadCount; ++i) {
+        QThread *thread = new QThread(this);
+        QObject *worker = new QObject;
+        worker->moveToThread(thread);
+        connect(thread, &QThread::finished, worker, &QObject::deleteLater);
+        thread->start();
+        m_threads << thread;
+        m_workers << worker;
+    }
+
+    for (QObject *worker : std::as_const(m_workers)) {
+        bool leased = false;
+        QString error;
+        QMetaObject::invokeMethod(worker, [this, &leased, &error]() {
+            ConnectionLease lease = m_pool->acquire(2000);
+            if (!lease.isValid()) {
+                error = "connection unavailable";
+                return;
+            }
+            QSqlQuery query(lease.database());
+            leased = query.exec("SELECT 1");
+            error = query.lastError().text();
+        }, Qt::BlockingQueuedConnection);
+        QVERIFY2(leased, qPrintable(error));
+    }
+
+    const QVariantMap statistics = m_pool->statistics();
+    QCOMPARE(statistics.value("timeouts").toInt(), 0);
+    QVERIFY(statistics.value("size").toInt() <= 3);
+}
+
+/**
+ * @brief Close the pooled connections on their threads and stop the threads
+ */
+void TestConnectionPool::cleanupTestCase() {
+    for (int i = 0; i < m_threads.size(); ++i) {
+        QMetaObject::invokeMethod(m_workers.at(i), [this]() { m_pool->releaseThread(); }, Qt::BlockingQueuedConnection);
+        m_threads.at(i)->quit();
+        m_threads.at(i)->wait();
+    }
+    if (m_pool)
+        ConnectionPool::remove(QSqlDatabase::database().connectionName());
+    m_pool.reset();
+}
+
+QTEST_GUILESS_MAIN(TestConnectionPool)
+#include "tst_connectionpool.moc"
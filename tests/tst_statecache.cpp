@@ -0,0 +1,85 @@
+#include <QSqlDatabase>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QUuid>
+#include <QtTest>
+#include "databasetables.h"
+#include "statecache.h"
+
+/**
+ * @brief State cache tests
+ *
+ * Run against the PostgreSQL database named by the PFINANCE_TEST_DBNAME,
+ * PFINANCE_TEST_HOST, PFINANCE_TEST_PORT, PFINANCE_TEST_USERNAME and
+ * PFINANCE_TEST_PASSWORD environment variables. Skipped when no database is named.
+ */
+class TestStateCache : public QObject
+{
+    Q_OBJECT
+    DatabaseTables *m_tables = nullptr;             // Table schemas
+    QString m_object;                               // Object name unique to this run
+
+private slots:
+    void initTestCase();
+    void restoresSavedState();
+    void cleanupTestCase();
+};
+
+/**
+ * @brief Connect to the test database and create the States table
+ */
+void TestStateCache::initTestCase() {
+    const QString dbname = qEnvironmentVariable("PFINANCE_TEST_DBNAME");
+    if (dbname.isEmpty())
+        QSKIP("PFINANCE_TEST_DBNAME is not set");
+
+    QSqlDatabase db = QSqlDatabase::addDatabase("QPSQL");
+    db.setHostName(qEnvironmentVariable("PFINANCE_TEST_HOST", "localhost"));
+    db.setPort(qEnvironmentVariableIntValue("PFINANCE_TEST_PORT") ? qEnvironmentVariableIntValue("PFINANCE_TEST_PORT") : 5432);
+    db.setDatabaseName(dbname);
+    db.setUserName(qEnvironmentVariable("PFINANCE_TEST_USERNAME"));
+    db.setPassword(qEnvironmentVariable("PFINANCE_TEST_PASSWORD"));
+    QVERIFY2(db.open(), qPrintable(db.lastError().text()));
+
+    m_tables = new DatabaseTables(this);
+    const TableSchema *states = m_tables->fetch("States");
+    QSqlQuery query(db);
+    QVERIFY2(query.exec("CREATE EXTENSION IF NOT EXISTS pgcrypto"), qPrintable(query.lastError().text()));
+    QVERIFY2(query.exec(states->createTableSql()), qPrintable(query.lastError().text()));
+    for (const IndexDefinition &index : states->indexes())
+        QVERIFY2(query.exec(states->createIndexSql(index)), qPrintable(query.lastError().text()));
+
+    m_object = "tst_statecache_" + QUuid::createUuid().toString(QUuid::Id128);
+}
+
+/**
+ * @brief A value saved through one cache is preloaded by a fresh cache
+ */
+void TestStateCache::restoresSavedState() {
+    QSqlDatabase db = QSqlDatabase::database();
+
+    StateCache *cache = StateCache::forDatabase(db, m_tables);
+    cache->setValue(m_object, "sortColumn", "ven_name");
+    QVERIFY(cache->flush());
+    delete cache;
+
+    StateCache *fresh = StateCache::forDatabase(db, m_tables);
+    QVERIFY(fresh->contains(m_object, "sortColumn"));
+    QCOMPARE(fresh->value(m_object, "sortColumn"), QString("ven_name"));
+    delete fresh;
+}
+
+/**
+ * @brief Remove the rows written by the test
+ */
+void TestStateCache::cleanupTestCase() {
+    if (m_object.isEmpty())
+        return;
+    QSqlQuery query(QSqlDatabase::database());
+    query.prepare(QString("DELETE FROM %1 WHERE object = :object").arg(m_tables->fetch("States")->tableName(true)));
+    query.bindValue(":object", m_object);
+    query.exec();
+}
+
+QTEST_GUILESS_MAIN(TestStateCache)
+#include "tst_statecache.moc"
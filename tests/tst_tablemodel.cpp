@@ -0,0 +1,115 @@
+#include <QSqlDatabase>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QUuid>
+#include <QtTest>
+#include "base/connectionpool.h"
+#include "databasetables.h"
+#include "tablemodel.h"
+
+/**
+ * @brief Table model tests
+ *
+ * Run against the PostgreSQL database named by the PFINANCE_TEST_DBNAME,
+ * PFINANCE_TEST_HOST, PFINANCE_TEST_PORT, PFINANCE_TEST_USERNAME and
+ * PFINANCE_TEST_PASSWORD environment variables. Skipped when no database is named.
+ */
+class TestTableModel : public QObject
+{
+    Q_OBJECT
+    std::shared_ptr<ConnectionPool> m_pool;         // Pool the model loader leases from
+    DatabaseTables *m_tables = nullptr;             // Table schemas
+    QString m_categoryId;                           // Category of the vendors written by this run
+    static constexpr int vendorCount = 1200;        // Vendors written by this run
+
+private slots:
+    void initTestCase();
+    void windowedReadsBlocksInBackground();
+    void cleanupTestCase();
+};
+
+/**
+ * @brief Connect to the test database, create the tables and write the vendors
+ */
+void TestTableModel::initTestCase() {
+    const QString dbname = qEnvironmentVariable("PFINANCE_TEST_DBNAME");
+    if (dbname.isEmpty())
+        QSKIP("PFINANCE_TEST_DBNAME is not set");
+
+    QSqlDatabase db = QSqlDatabase::addDatabase("QPSQL");
+    db.setHostName(qEnvironmentVariable("PFINANCE_TEST_HOST", "localhost"));
+    db.setPort(qEnvironmentVariableIntValue("PFINANCE_TEST_PORT") ? qEnvironmentVariableIntValue("PFINANCE_TEST_PORT") : 5432);
+    db.setDatabaseName(dbname);
+    db.setUserName(qEnvironmentVariable("PFINANCE_TEST_USERNAME"));
+    db.setPassword(qEnvironmentVariable("PFINANCE_TEST_PASSWORD"));
+    QVERIFY2(db.open(), qPrintable(db.lastError().text()));
+    m_pool = ConnectionPool::create(db, 1, 4, 60000);
+
+    m_tables = new DatabaseTables(this);
+    QSqlQuery query(db);
+    QVERIFY2(query.exec("CREATE EXTENSION IF NOT EXISTS pgcrypto"), qPrintable(query.lastError().text()));
+    for (const QString &name : { QString("States"), QString("Vendors") }) {
+        const TableSchema *table = m_tables->fetch(name);
+        QVERIFY2(query.exec(table->createTableSql()), qPrintable(query.lastError().text()));
+        for (const IndexDefinition &index : table->indexes())
+            QVERIFY2(query.exec(table->createIndexSql(index)), qPrintable(query.lastError().text()));
+    }
+
+    // Vendors of a category unique to this run, so the window only sees them
+    m_categoryId = QUuid::createUuid().toString(QUuid::WithoutBraces);
+    query.prepare(QString(R"(
+        INSERT INTO %1 (category_id, name, address1, address2, city, state, postal_code, phone)
+        SELECT :category_id, 'Vendor ' || lpad(n::text, 5, '0'), '', '', '', '', '', ''
+        FROM generate_series(1, %2) AS n
+    )").arg(m_tables->fetch("Vendors")->tableName(true))     // %1 = Vendor table name
+       .arg(vendorCount));                                 // %2 = Number of vendors written
+    query.bindValue(":category_id", m_categoryId);
+    QVERIFY2(query.exec(), qPrintable(query.lastError().text()));
+}
+
+/**
+ * @brief A windowed model counts every row but only reads blocks as they are needed
+ *
+ * The window is opened and its blocks are read by the loader. A row outside
+ * the resident blocks reads as empty until dataChanged reports its block.
+ */
+void TestTableModel::windowedReadsBlocksInBackground() {
+    TableModel model(QSqlDatabase::database(), m_tables, "Vendors");
+    model.setPageSize(100);
+    model.setWindowed(true);
+    QVERIFY(model.async());
+    model.setFilter("ven_category_id", "equals", m_categoryId);
+
+    QTRY_COMPARE_WITH_TIMEOUT(model.rowCount(), vendorCount, 10000);
+    QTRY_VERIFY_WITH_TIMEOUT(!model.loading(), 10000);
+
+    // The first block arrives with the window
+    QVERIFY(model.data(model.index(0, 0), IdRole).isValid());
+
+    // A far row is read in the background
+    QSignalSpy changed(&model, &TableModel::dataChanged);
+    const QModelIndex far = model.index(vendorCount - 50, 0);
+    QVERIFY(!model.data(far, IdRole).isValid());
+    QTRY_VERIFY_WITH_TIMEOUT(!changed.isEmpty(), 10000);
+    const QString farId = model.data(far, IdRole).toString();
+    QVERIFY(!farId.isEmpty());
+    QCOMPARE(model.rowOf(farId), far.row());
+}
+
+/**
+ * @brief Remove the rows written by the test
+ */
+void TestTableModel::cleanupTestCase() {
+    if (!m_categoryId.isEmpty()) {
+        QSqlQuery query(QSqlDatabase::database());
+        query.prepare(QString("DELETE FROM %1 WHERE category_id = :category_id").arg(m_tables->fetch("Vendors")->tableName(true)));
+        query.bindValue(":category_id", m_categoryId);
+        query.exec();
+    }
+    if (m_pool)
+        ConnectionPool::remove(QSqlDatabase::database().connectionName());
+    m_pool.reset();
+}
+
+QTEST_GUILESS_MAIN(TestTableModel)
+#include "tst_tablemodel.moc"